@@ -0,0 +1,51 @@
+/*
+ * dm.h : private structures of the Linux device-mapper targets
+ *
+ * These are copied from drivers/md/dm-linear.c and drivers/md/dm-stripe.c
+ * of the RHEL7 kernel, because they are not exposed to the public header.
+ *
+ * This file is released under the GPL.
+ */
+#ifndef _DM_LOCAL_H
+#define _DM_LOCAL_H
+
+#include <linux/device-mapper.h>
+
+/*
+ * Linear: maps a linear range of a device.
+ */
+struct linear_c {
+	struct dm_dev *dev;
+	sector_t start;
+};
+
+/*
+ * Striped: maps the chunks to the devices in round robin.
+ */
+struct stripe {
+	struct dm_dev *dev;
+	sector_t physical_start;
+
+	atomic_t error_count;
+};
+
+struct stripe_c {
+	uint32_t stripes;
+	int stripes_shift;
+
+	/* The size of this target / num. stripes */
+	sector_t stripe_width;
+
+	uint32_t chunk_size;
+	int chunk_size_shift;
+
+	/* Needed for handling events */
+	struct dm_target *ti;
+
+	/* Work struct used for triggering events*/
+	struct work_struct trigger_event;
+
+	struct stripe stripe[0];
+};
+
+#endif	/* _DM_LOCAL_H */
@@ -91,6 +91,83 @@ __nvme_alloc_request(struct request_queue *q,
 	return p_nvme_alloc_request(q, cmd, flags);
 }
 
+/* nvme_identify_ctrl */
+static struct module *mod_nvme_identify_ctrl = NULL;
+static int (* p_nvme_identify_ctrl)(
+	struct nvme_ctrl *dev,
+	struct nvme_id_ctrl **id) = NULL;
+
+static inline int
+__nvme_identify_ctrl(struct nvme_ctrl *dev, struct nvme_id_ctrl **id)
+{
+	if (!p_nvme_identify_ctrl)
+		return -ENOTSUPP;
+	return p_nvme_identify_ctrl(dev, id);
+}
+
+/* dm_get_live_table */
+static struct module *mod_dm_get_live_table = NULL;
+static struct dm_table *(* p_dm_get_live_table)(
+	struct mapped_device *md,
+	int *srcu_idx) = NULL;
+
+static inline struct dm_table *
+__dm_get_live_table(struct mapped_device *md, int *srcu_idx)
+{
+	BUG_ON(!p_dm_get_live_table);
+	return p_dm_get_live_table(md, srcu_idx);
+}
+
+/* dm_put_live_table */
+static struct module *mod_dm_put_live_table = NULL;
+static void (* p_dm_put_live_table)(
+	struct mapped_device *md,
+	int srcu_idx) = NULL;
+
+static inline void
+__dm_put_live_table(struct mapped_device *md, int srcu_idx)
+{
+	BUG_ON(!p_dm_put_live_table);
+	p_dm_put_live_table(md, srcu_idx);
+}
+
+/* dm_table_get_num_targets */
+static struct module *mod_dm_table_get_num_targets = NULL;
+static unsigned int (* p_dm_table_get_num_targets)(
+	struct dm_table *t) = NULL;
+
+static inline unsigned int
+__dm_table_get_num_targets(struct dm_table *t)
+{
+	BUG_ON(!p_dm_table_get_num_targets);
+	return p_dm_table_get_num_targets(t);
+}
+
+/* dm_table_get_target */
+static struct module *mod_dm_table_get_target = NULL;
+static struct dm_target *(* p_dm_table_get_target)(
+	struct dm_table *t,
+	unsigned int index) = NULL;
+
+static inline struct dm_target *
+__dm_table_get_target(struct dm_table *t, unsigned int index)
+{
+	BUG_ON(!p_dm_table_get_target);
+	return p_dm_table_get_target(t, index);
+}
+
+/* md_wakeup_thread */
+static struct module *mod_md_wakeup_thread = NULL;
+static void (* p_md_wakeup_thread)(
+	struct md_thread *thread) = NULL;
+
+static inline void
+__md_wakeup_thread(struct md_thread *thread)
+{
+	if (p_md_wakeup_thread)
+		p_md_wakeup_thread(thread);
+}
+
 /* ext4_get_block */
 static struct module *mod_ext4_get_block = NULL;
 static int (* p_ext4_get_block)(
@@ -181,6 +258,15 @@ strom_update_extra_symbols(struct notifier_block *nb,
 	LOOKUP_OPTIONAL_EXTRA_SYMBOL(nvidia_p2p_get_pages);
 	LOOKUP_OPTIONAL_EXTRA_SYMBOL(nvidia_p2p_put_pages);
 	LOOKUP_OPTIONAL_EXTRA_SYMBOL(nvidia_p2p_free_page_table);
+	/* nvme */
+	LOOKUP_OPTIONAL_EXTRA_SYMBOL(nvme_identify_ctrl);
+	/* device-mapper */
+	LOOKUP_OPTIONAL_EXTRA_SYMBOL(dm_get_live_table);
+	LOOKUP_OPTIONAL_EXTRA_SYMBOL(dm_put_live_table);
+	LOOKUP_OPTIONAL_EXTRA_SYMBOL(dm_table_get_num_targets);
+	LOOKUP_OPTIONAL_EXTRA_SYMBOL(dm_table_get_target);
+	/* md-raid */
+	LOOKUP_OPTIONAL_EXTRA_SYMBOL(md_wakeup_thread);
 	/* ext4 */
 	LOOKUP_OPTIONAL_EXTRA_SYMBOL(ext4_get_block);
 	/* xfs */
@@ -200,10 +286,18 @@ strom_put_all_extra_modules(void)
 {
 	/* nvme */
 	module_put(mod_nvme_alloc_request);
+	module_put(mod_nvme_identify_ctrl);
 	/* nvidia */
 	module_put(mod_nvidia_p2p_get_pages);
 	module_put(mod_nvidia_p2p_put_pages);
 	module_put(mod_nvidia_p2p_free_page_table);
+	/* device-mapper */
+	module_put(mod_dm_get_live_table);
+	module_put(mod_dm_put_live_table);
+	module_put(mod_dm_table_get_num_targets);
+	module_put(mod_dm_table_get_target);
+	/* md-raid */
+	module_put(mod_md_wakeup_thread);
 	/* file systems */
 	module_put(mod_ext4_get_block);
 	module_put(mod_xfs_get_blocks);
@@ -19,9 +19,11 @@
 #include <linux/anon_inodes.h>
 #include <linux/blk-mq.h>
 #include <linux/buffer_head.h>
+#include <linux/eventfd.h>
 #include <linux/fdtable.h>
 #include <linux/file.h>
 #include <linux/fs.h>
+#include <linux/hash.h>
 #include <linux/idr.h>
 #include <linux/kallsyms.h>
 #include <linux/kernel.h>
@@ -30,9 +32,14 @@
 #include <linux/moduleparam.h>
 #include <linux/nvme.h>
 #include <linux/pci.h>
+#include <linux/poll.h>
 #include <linux/proc_fs.h>
 #include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
 #include <linux/version.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 #include <uapi/linux/nvme_ioctl.h>
 #include <generated/utsrelease.h>
 #include "nv-p2p.h"
@@ -65,6 +72,25 @@ MODULE_PARM_DESC(verbose, "turn on/off debug message");
 static int	stat_info = 1;
 module_param(stat_info, int, 0644);
 MODULE_PARM_DESC(stat_info, "turn on/off run-time statistics");
+/* hybrid polling on the wait for DMA tasks */
+static int	hybrid_polling = 0;
+module_param(hybrid_polling, int, 0644);
+MODULE_PARM_DESC(hybrid_polling, "spin prior to sleep on the wait for DMA tasks, even if not required by the caller");
+static int	hybrid_polling_max_us = 200;
+module_param(hybrid_polling_max_us, int, 0644);
+MODULE_PARM_DESC(hybrid_polling_max_us, "upper limit of the spin by hybrid polling [us]");
+/* NUMA affinity of DMA submission / completion */
+static int	numa_affinity = 0;
+module_param(numa_affinity, int, 0644);
+MODULE_PARM_DESC(numa_affinity, "submit DMA on a CPU of the NUMA node where the destination buffer is located");
+/* SGL descriptors, if supported by the controller */
+static int	use_sgl = 1;
+module_param(use_sgl, int, 0644);
+MODULE_PARM_DESC(use_sgl, "use SGL, rather than PRPs, if NVMe controller supports");
+/* merge of READ commands across the small gap */
+static int	max_merge_gap_kb = 0;
+module_param(max_merge_gap_kb, int, 0644);
+MODULE_PARM_DESC(max_merge_gap_kb, "default max size of the gap to be read into the scratch page, to merge READ commands on the sorted SSD2RAM [KB]");
 static atomic64_t	stat_nr_ssd2gpu = ATOMIC64_INIT(0);
 static atomic64_t	stat_clk_ssd2gpu = ATOMIC64_INIT(0);
 static atomic64_t	stat_nr_setup_prps = ATOMIC64_INIT(0);
@@ -76,6 +102,20 @@ static atomic64_t	stat_clk_wait_dtask = ATOMIC64_INIT(0);
 static atomic64_t	stat_nr_wrong_wakeup = ATOMIC64_INIT(0);
 static atomic64_t	stat_cur_dma_count = ATOMIC64_INIT(0);
 static atomic64_t	stat_max_dma_count = ATOMIC64_INIT(0);
+static atomic64_t	stat_nr_dtask_alloc_hit = ATOMIC64_INIT(0);
+static atomic64_t	stat_nr_dtask_alloc_miss = ATOMIC64_INIT(0);
+static atomic64_t	stat_nr_cmd_cxt_alloc_hit = ATOMIC64_INIT(0);
+static atomic64_t	stat_nr_cmd_cxt_alloc_miss = ATOMIC64_INIT(0);
+static atomic64_t	stat_nr_numa_submit_local = ATOMIC64_INIT(0);
+static atomic64_t	stat_nr_numa_submit_steered = ATOMIC64_INIT(0);
+static atomic64_t	stat_nr_numa_complete_local = ATOMIC64_INIT(0);
+static atomic64_t	stat_nr_numa_complete_remote = ATOMIC64_INIT(0);
+static atomic64_t	stat_nr_extent_cache_hit = ATOMIC64_INIT(0);
+static atomic64_t	stat_nr_extent_cache_miss = ATOMIC64_INIT(0);
+static atomic64_t	stat_nr_gap_merge = ATOMIC64_INIT(0);
+static atomic64_t	stat_bytes_gap_waste = ATOMIC64_INIT(0);
+static atomic64_t	stat_nr_zero_fill = ATOMIC64_INIT(0);
+static atomic64_t	stat_nr_hybrid_copy = ATOMIC64_INIT(0);
 static atomic64_t	stat_nr_debug1 = ATOMIC64_INIT(0);
 static atomic64_t	stat_nr_debug2 = ATOMIC64_INIT(0);
 static atomic64_t	stat_nr_debug3 = ATOMIC64_INIT(0);
@@ -98,6 +138,19 @@ atomic64_max_return(long newval, atomic64_t *atomic_ptr)
 	return maxval;
 }
 
+static inline int
+atomic_max_return(int newval, atomic_t *atomic_ptr)
+{
+	int		oldval, maxval;
+	do {
+		maxval = atomic_read(atomic_ptr);
+		if (newval <= maxval)
+			break;
+		oldval = atomic_cmpxchg(atomic_ptr, maxval, newval);
+	} while (oldval != maxval);
+	return maxval;
+}
+
 
 #define prDebug(fmt, ...)												\
 	do {																\
@@ -117,12 +170,13 @@ atomic64_max_return(long newval, atomic64_t *atomic_ptr)
 	printk(KERN_ERR "nvme-strom: " fmt "\n", ##__VA_ARGS__)
 
 /*
- * NOTE: It looks to us NVMe SSD does not accept DMA request larger than 128kB,
- * according to the execution on Intel 750 SSD, however, we are also uncertain
- * whether it is a common specification for all the NVMe-SSD device.
- * Right now, we have 128kB as a default maximum unit size of DMA request.
+ * NOTE: Maximum data transfer size (MDTS) depends on the controller; e.g,
+ * Intel 750 SSD does not accept DMA request larger than 128kB, but modern
+ * devices accept 512kB-2MB. NVMESSD_DMAREQ_MAXSZ is the upper limit of this
+ * module, and the actual limit of DMA request is determined for each NVMe
+ * namespace by strom_nvme_max_sectors().
  */
-#define NVMESSD_DMAREQ_MAXSZ		(128 * 1024)
+#define NVMESSD_DMAREQ_MAXSZ		(2048 * 1024)
 
 /* routines for extra symbols */
 #include "extra_ksyms.c"
@@ -136,9 +190,15 @@ atomic64_max_return(long newval, atomic64_t *atomic_ptr)
 /* procfs entry of "/proc/nvme-strom" */
 static struct proc_dir_entry  *nvme_strom_proc = NULL;
 
+/* destination of the blocks being not necessary, but read together */
+static struct page	   *strom_scratch_page = NULL;
+
 /* rdtsc() is defined at msr.h if x86_64 */
-#ifndef CONFIG_X86_64
+#ifdef CONFIG_X86_64
+#include <asm/tsc.h>		/* tsc_khz */
+#else
 #define rdtsc()				(0UL)
+#define tsc_khz				(0U)	/* hybrid polling is not available */
 #endif
 
 #include "pmemmap.c"
@@ -330,21 +390,55 @@ __mdblock_is_supported_nvme(struct block_device *blkdev,
 		return -ENOTSUPP;
 	}
 
-	if (mddev->level != 0 || mddev->layout != 0)
+	/*
+	 * RAID-0, RAID-1 and RAID-10 with near layout are supported.
+	 * RAID-10 layout consists of near_copies (bits 0-7), far_copies
+	 * (bits 8-15) and far_offset (bit 16); see setup_geo() at
+	 * drivers/md/raid10.c.
+	 */
+	if (mddev->level == 0)
+	{
+		if (mddev->layout != 0)
+		{
+			prError("md-device '%s' has unsupported RAID-0 layout",
+					bd_disk->disk_name);
+			return -ENOTSUPP;
+		}
+	}
+	else if (mddev->level == 10)
+	{
+		if ((mddev->layout & 0xff) < 1 ||
+			(mddev->layout >> 8) != 1 ||
+			(mddev->chunk_sectors & (mddev->chunk_sectors - 1)) != 0)
+		{
+			prError("md-device '%s' is not RAID-10 with near layout",
+					bd_disk->disk_name);
+			return -ENOTSUPP;
+		}
+	}
+	else if (mddev->level != 1)
 	{
-		prError("md-device '%s' is not configured as RAID-0 volume",
+		prError("md-device '%s' is not configured as RAID-0/1/10 volume",
 				bd_disk->disk_name);
 		return -ENOTSUPP;
 	}
 
-	if (mddev->chunk_sectors < (PAGE_CACHE_SIZE >> 9) ||
-		(mddev->chunk_sectors & ((PAGE_CACHE_SIZE >> 9) - 1)) != 0)
+	if (mddev->level != 1 &&
+		(mddev->chunk_sectors < (PAGE_CACHE_SIZE >> 9) ||
+		 (mddev->chunk_sectors & ((PAGE_CACHE_SIZE >> 9) - 1)) != 0))
 	{
 		prError("md-device '%s' has invalid stripe size: %zu",
 				bd_disk->disk_name, (size_t)mddev->chunk_sectors << 9);
 		return -ENOTSUPP;
 	}
 
+	if (mddev->level != 0 && mddev->reshape_position != MaxSector)
+	{
+		prError("md-device '%s' is under reshaping",
+				bd_disk->disk_name);
+		return -ENOTSUPP;
+	}
+
 	/* check for each underlying devices */
 	rdev_for_each(rdev, mddev)
 	{
@@ -359,7 +453,7 @@ __mdblock_is_supported_nvme(struct block_device *blkdev,
 		}
 	}
 
-	/* ok, MD RAID-0 volume consists of all NVMe-SSD devices */
+	/* ok, MD RAID volume consists of all NVMe-SSD devices */
 	if (p_mddev)
 		*p_mddev = mddev;
 
@@ -367,30 +461,179 @@ __mdblock_is_supported_nvme(struct block_device *blkdev,
 }
 
 /*
- * file_is_supported_nvme
+ * __blkdev_is_device_mapper - checks whether the block device is a mapped
+ * device of dm_mod; it also has to provide the extra symbols to walk on
+ * the device-mapper table.
+ */
+static inline bool
+__blkdev_is_device_mapper(struct gendisk *bd_disk)
+{
+	return (mod_dm_get_live_table != NULL &&
+			p_dm_get_live_table != NULL &&
+			p_dm_put_live_table != NULL &&
+			p_dm_table_get_num_targets != NULL &&
+			p_dm_table_get_target != NULL &&
+			bd_disk->fops->owner == mod_dm_get_live_table);
+}
+
+/*
+ * target types of device-mapper we support. They are static objects of
+ * dm-mod, so we remember them on the checks of the device, then the target
+ * of each page is identified by the pointer, not by the name.
+ */
+static struct target_type *strom_dm_linear_type = NULL;
+static struct target_type *strom_dm_striped_type = NULL;
+
+/*
+ * __dmblock_is_supported_nvme - checker for device-mapper
  */
 static int
-file_is_supported_nvme(struct file *filp,
-					   int *p_numa_node_id,
-					   int *p_support_dma64,
-					   struct mddev **p_mddev)
+__dmblock_is_supported_nvme(struct block_device *blkdev,
+							int *p_numa_node_id,
+							int *p_support_dma64,
+							struct mapped_device **p_dm_md)
 {
-	struct inode	   *f_inode = filp->f_inode;
-	struct super_block *i_sb = f_inode->i_sb;
-	struct file_system_type *s_type = i_sb->s_type;
-	struct block_device *s_bdev = i_sb->s_bdev;
-	struct gendisk	   *bd_disk = s_bdev->bd_disk;
+	struct gendisk *bd_disk = blkdev->bd_disk;
+	struct mapped_device *md = bd_disk->private_data;
+	struct dm_table *map;
+	struct dm_target *ti;
+	const char	   *dname;
+	unsigned int	page_sects = (PAGE_CACHE_SIZE >> SECTOR_SHIFT);
+	unsigned int	i, j, nr_targets;
+	int				srcu_idx;
+	int				rc = 0;
+
+	/* disk_name should be 'dm-%d' */
+	dname = bd_disk->disk_name;
+	if (dname[0] == 'd' &&
+		dname[1] == 'm' &&
+		dname[2] == '-')
+	{
+		const char *pos = dname + 3;
+		const char *pos_saved = pos;
+
+		while (*pos >= '0' && *pos <= '9')
+			pos++;
+		if (pos > pos_saved && *pos == '\0')
+			dname = NULL;
+	}
+
+	if (dname)
+	{
+		prError("block device '%s' is not supported", dname);
+		return -ENOTSUPP;
+	}
 
 	/*
-	 * must have proper permission to the target file
+	 * check device-mapper table; only linear and striped targets over
+	 * the raw NVMe-SSD devices are supported.
 	 */
-	if ((filp->f_mode & FMODE_READ) == 0)
+	map = __dm_get_live_table(md, &srcu_idx);
+	if (!map)
 	{
-		prError("process (pid=%u) has no permission to read file",
-				current->pid);
-		return -EACCES;
+		prError("dm-device '%s' has no active table",
+				bd_disk->disk_name);
+		rc = -ENOTSUPP;
+		goto out;
+	}
+
+	nr_targets = __dm_table_get_num_targets(map);
+	if (nr_targets == 0)
+	{
+		prError("dm-device '%s' contains no targets",
+				bd_disk->disk_name);
+		rc = -ENOTSUPP;
+		goto out;
+	}
+
+	for (i=0; i < nr_targets; i++)
+	{
+		ti = __dm_table_get_target(map, i);
+
+		/* a page must not go across the boundary of targets */
+		if ((ti->begin & (page_sects - 1)) != 0 ||
+			(ti->len & (page_sects - 1)) != 0)
+		{
+			prError("dm-device '%s' - target[%u] is not aligned to PAGE_CACHE_SIZE",
+					bd_disk->disk_name, i);
+			rc = -ENOTSUPP;
+			goto out;
+		}
+
+		if (strcmp(ti->type->name, "linear") == 0)
+		{
+			struct linear_c *lc = ti->private;
+
+			ACCESS_ONCE(strom_dm_linear_type) = ti->type;
+			rc = __extblock_is_supported_nvme(lc->dev->bdev,
+											  p_numa_node_id,
+											  p_support_dma64);
+		}
+		else if (strcmp(ti->type->name, "striped") == 0)
+		{
+			struct stripe_c *sc = ti->private;
+
+			ACCESS_ONCE(strom_dm_striped_type) = ti->type;
+			if (sc->chunk_size < page_sects ||
+				(sc->chunk_size & (page_sects - 1)) != 0)
+			{
+				prError("dm-device '%s' - target[%u] has invalid stripe size: %zu",
+						bd_disk->disk_name, i,
+						(size_t)sc->chunk_size << SECTOR_SHIFT);
+				rc = -ENOTSUPP;
+				goto out;
+			}
+			for (j=0; j < sc->stripes && rc == 0; j++)
+				rc = __extblock_is_supported_nvme(sc->stripe[j].dev->bdev,
+												  p_numa_node_id,
+												  p_support_dma64);
+		}
+		else
+		{
+			prError("dm-device '%s' - target[%u] has unsupported type: %s",
+					bd_disk->disk_name, i, ti->type->name);
+			rc = -ENOTSUPP;
+			goto out;
+		}
+
+		if (rc)
+		{
+			prError("dm-device '%s' - target[%u] is not on NVMe-SSD",
+					bd_disk->disk_name, i);
+			goto out;
+		}
 	}
 
+	/* ok, dm volume consists of all NVMe-SSD devices */
+	if (p_dm_md)
+		*p_dm_md = md;
+out:
+	__dm_put_live_table(md, srcu_idx);
+	return rc;
+}
+
+/*
+ * strom_file_bdev - block device on behalf of the source file; the device
+ * itself if raw block device is given, or the one of the filesystem.
+ */
+static inline struct block_device *
+strom_file_bdev(struct file *filp)
+{
+	if (S_ISBLK(filp->f_inode->i_mode))
+		return I_BDEV(filp->f_mapping->host);
+	return filp->f_inode->i_sb->s_bdev;
+}
+
+/*
+ * __file_is_supported_filesystem - checks filesystem of the source file
+ */
+static int
+__file_is_supported_filesystem(struct file *filp)
+{
+	struct inode	   *f_inode = filp->f_inode;
+	struct super_block *i_sb = f_inode->i_sb;
+	struct file_system_type *s_type = i_sb->s_type;
+
 	/*
 	 * check whether it is on supported filesystem
 	 *
@@ -423,7 +666,8 @@ file_is_supported_nvme(struct file *filp,
 	if (i_sb->s_blocksize > PAGE_CACHE_SIZE)
 	{
 		prError("block size of '%s' is %zu; larger than PAGE_CACHE_SIZE",
-				bd_disk->disk_name, (size_t)i_sb->s_blocksize);
+				i_sb->s_bdev->bd_disk->disk_name,
+				(size_t)i_sb->s_blocksize);
 		return -ENOTSUPP;
 	}
 
@@ -444,10 +688,50 @@ file_is_supported_nvme(struct file *filp,
 	}
 	spin_unlock(&f_inode->i_lock);
 
+	return 0;
+}
+
+/*
+ * file_is_supported_nvme
+ */
+static int
+file_is_supported_nvme(struct file *filp,
+					   int *p_numa_node_id,
+					   int *p_support_dma64,
+					   struct mddev **p_mddev,
+					   struct mapped_device **p_dm_md)
+{
+	struct inode	   *f_inode = filp->f_inode;
+	struct block_device *s_bdev = strom_file_bdev(filp);
+	struct gendisk	   *bd_disk = s_bdev->bd_disk;
+
+	/*
+	 * must have proper permission to the target file
+	 */
+	if ((filp->f_mode & FMODE_READ) == 0)
+	{
+		prError("process (pid=%u) has no permission to read file",
+				current->pid);
+		return -EACCES;
+	}
+
+	/*
+	 * check whether it is on supported filesystem, unless the source is
+	 * raw block device.
+	 */
+	if (!S_ISBLK(f_inode->i_mode))
+	{
+		int		rc = __file_is_supported_filesystem(filp);
+
+		if (rc)
+			return rc;
+	}
+
 	/*
 	 * check whether the block device is either of:
 	 * 1. physical NVMe-SSD device, or
-	 * 2. logical MD RAID-0 device which consists of only NVMe-SSDs
+	 * 2. logical MD RAID-0/1/10 device which consists of only NVMe-SSDs
+	 * 3. device-mapper (LVM) linear/striped volume on only NVMe-SSDs
 	 */
 	if (bd_disk->major == BLOCK_EXT_MAJOR)
 		return __extblock_is_supported_nvme(s_bdev,
@@ -458,6 +742,11 @@ file_is_supported_nvme(struct file *filp,
 										   p_numa_node_id,
 										   p_support_dma64,
 										   p_mddev);
+	else if (__blkdev_is_device_mapper(bd_disk))
+		return __dmblock_is_supported_nvme(s_bdev,
+										   p_numa_node_id,
+										   p_support_dma64,
+										   p_dm_md);
 
 	prError("block device '%s' on behalf of the file is not supported",
 			bd_disk->disk_name);
@@ -488,6 +777,7 @@ ioctl_check_file(StromCmd__CheckFile __user *uarg)
 	rc = file_is_supported_nvme(filp,
 								&numa_node_id,
 								&support_dma64,
+								NULL,
 								NULL);
 	fput(filp);
 
@@ -509,795 +799,3277 @@ ioctl_check_file(StromCmd__CheckFile __user *uarg)
  */
 struct nvme_ns;
 
-struct strom_dma_task
-{
-	struct list_head	chain;
-	unsigned long		dma_task_id;/* ID of this DMA task */
-	int					hindex;		/* index of hash slot */
-	atomic_t			refcnt;		/* reference counter */
-	bool				frozen;		/* (DEBUG) no longer newly referenced */
-	mapped_gpu_memory  *mgmem;		/* destination GPU memory segment */
-	strom_dma_buffer   *sd_buf;		/* destination host mapped DMA buffer */
-	/* reference to the backing file */
-	struct file		   *filp;		/* source file */
-	/* MD RAID-0 configuration, if any */
-	struct mddev	   *mddev;
-	/* current focus of the raw NVMe-SSD device */
-	struct nvme_ns	   *nvme_ns;	/* NVMe namespace (=SCSI LUN) */
-
-	/*
-	 * status of asynchronous tasks
-	 *
-	 * MEMO: Pay attention to error status of the asynchronous tasks.
-	 * Asynchronous task may cause errors on random timing, and kernel
-	 * space wants to inform this status on the next call. On the other
-	 * hands, application may invoke ioctl(2) to reference DMA results,
-	 * but may not. So, we have to keep an error status somewhere, but
-	 * also needs to be released on appropriate timing; to avoid kernel
-	 * memory leak by rude applications.
-	 * If any errors, we attach strom_dma_task structure on file handler
-	 * used for ioctl(2). The error status shall be reclaimed on the
-	 * next time when application wait for a particular DMA task, or
-	 * this file handler is closed.
-	 */
-	long				dma_status;
-	struct file		   *ioctl_filp;
-
-	/* state of the current pending SSD2GPU DMA request */
-	loff_t				dest_offset;/* current destination offset */
-	sector_t			head_sector;
-	unsigned int		nr_sectors;
-	/* temporary buffer for locked page cache in a chunk */
-	struct page		   *file_pages[NVMESSD_DMAREQ_MAXSZ / PAGE_CACHE_SIZE];
-};
-typedef struct strom_dma_task	strom_dma_task;
-
-#define STROM_DMA_TASK_NSLOTS_BITS	9
-#define STROM_DMA_TASK_NSLOTS		(1UL << STROM_DMA_TASK_NSLOTS_BITS)
-static spinlock_t		strom_dma_task_locks[STROM_DMA_TASK_NSLOTS];
-static struct list_head	strom_dma_task_slots[STROM_DMA_TASK_NSLOTS];
-static struct list_head	failed_dma_task_slots[STROM_DMA_TASK_NSLOTS];
-static wait_queue_head_t strom_dma_task_waitq[STROM_DMA_TASK_NSLOTS];
-
 /*
- * strom_dma_task_index
+ * strom_objcache - recycled objects on top of the kmem_cache
+ *
+ * DMA tasks and NVMe command contexts are allocated and released for each
+ * ioctl(2) or NVMe command. Released objects are kept in the spinlocked
+ * slots chosen by the CPU id (CPUs share a slot if more than
+ * STROM_OBJCACHE_NSLOTS), up to @slot_maxlen per slot, then the next
+ * allocation reuses them without any allocator round trip.
+ * A DMA task is large (~13KB) because of the per-page arrays, so only a
+ * few ones are kept per slot, and only the header fields are cleared on
+ * allocation; the per-page arrays are always set prior to reference.
  */
-static inline int
-strom_dma_task_index(unsigned long dma_task_id)
+#define STROM_OBJCACHE_NSLOTS		32
+#define STROM_OBJCACHE_DTASK_MAXLEN	4
+#define STROM_OBJCACHE_CMD_CXT_MAXLEN	64
+
+typedef struct strom_objcache_slot
 {
-	return hash_64(dma_task_id, STROM_DMA_TASK_NSLOTS_BITS);
-}
+	spinlock_t			lock;
+	void			   *freelist;	/* chain of the free objects; the first
+									 * word of objects points the next */
+	unsigned int		nitems;		/* number of the free objects */
+} ____cacheline_aligned_in_smp strom_objcache_slot;
 
-/*
- * strom_create_dma_task
- */
-static strom_dma_task *
-strom_create_dma_task(int fdesc,
-					  mapped_gpu_memory *mgmem,
-					  struct strom_dma_buffer *sd_buf,
-					  struct file *ioctl_filp)
+typedef struct strom_objcache
 {
-	strom_dma_task		   *dtask;
-	struct file			   *filp;
-	struct super_block	   *i_sb;
-	struct block_device	   *s_bdev;
-	struct mddev		   *mddev = NULL;
-	int						node_id = -2;
-	int						support_dma64 = 1;
-	long					retval;
-	unsigned long			flags;
+	struct kmem_cache  *cachep;
+	size_t				unitsz;
+	size_t				clearsz;	/* leading bytes cleared on alloc */
+	unsigned int		slot_maxlen;/* max number of free objects per slot */
+	atomic64_t		   *stat_nr_hit;
+	atomic64_t		   *stat_nr_miss;
+	strom_objcache_slot	slots[STROM_OBJCACHE_NSLOTS];
+} strom_objcache;
+
+static strom_objcache	strom_dma_task_cache;
+static strom_objcache	strom_cmd_cxt_cache;
 
-	/* either of GPU or Host memory can be destination */
-	Assert((mgmem != NULL && sd_buf == NULL) ||
-		   (mgmem == NULL && sd_buf != NULL));
+static __init int
+strom_objcache_init(strom_objcache *ocache, const char *name,
+					size_t unitsz, size_t clearsz, unsigned int slot_maxlen,
+					atomic64_t *stat_nr_hit, atomic64_t *stat_nr_miss)
+{
+	int		i;
 
-	/* ensure the source file is supported */
-	filp = fget(fdesc);
-	if (!filp)
+	Assert(unitsz >= sizeof(void *) && clearsz <= unitsz);
+	ocache->cachep = kmem_cache_create(name, unitsz, 0,
+									   SLAB_HWCACHE_ALIGN, NULL);
+	if (!ocache->cachep)
 	{
-		prError("file descriptor %d of process %u is not available",
-				fdesc, current->tgid);
-		return ERR_PTR(-EBADF);
+		prError("failed on kmem_cache_create(\"%s\")", name);
+		return -ENOMEM;
 	}
-	retval = file_is_supported_nvme(filp,
-									&node_id,
-									&support_dma64,
-									&mddev);
-	if (retval < 0)
+	ocache->unitsz = unitsz;
+	ocache->clearsz = clearsz;
+	ocache->slot_maxlen = slot_maxlen;
+	ocache->stat_nr_hit = stat_nr_hit;
+	ocache->stat_nr_miss = stat_nr_miss;
+	for (i=0; i < STROM_OBJCACHE_NSLOTS; i++)
 	{
-		fput(filp);
-		return ERR_PTR(retval);
+		spin_lock_init(&ocache->slots[i].lock);
+		ocache->slots[i].freelist = NULL;
+		ocache->slots[i].nitems = 0;
 	}
-	i_sb = filp->f_inode->i_sb;
-	s_bdev = i_sb->s_bdev;
+	return 0;
+}
 
-	/* allocate strom_dma_task object */
-	dtask = kzalloc(sizeof(strom_dma_task), GFP_KERNEL);
-	if (!dtask)
-	{
-		fput(filp);
-		return ERR_PTR(-ENOMEM);
-	}
-	dtask->dma_task_id	= (unsigned long) dtask;
-	dtask->hindex		= strom_dma_task_index(dtask->dma_task_id);
-    atomic_set(&dtask->refcnt, 1);
-	dtask->frozen		= false;
-    dtask->mgmem		= mgmem;
-	dtask->sd_buf		= sd_buf;
-    dtask->filp			= filp;
-	dtask->mddev		= mddev;
-	dtask->nvme_ns		= NULL;		/* to be set later */
-    dtask->dma_status	= 0;
-    dtask->ioctl_filp	= get_file(ioctl_filp);
-	dtask->dest_offset	= 0;
-	dtask->head_sector	= 0;
-	dtask->nr_sectors	= 0;
+static void
+strom_objcache_exit(strom_objcache *ocache)
+{
+	int		i;
 
-	/*
-	 * If no MD RAID-0 configuration here, the focused NVMe-SSD will not be
-	 * changed during execution. So, we setup nvme_ns here.
-	 */
-	if (!mddev)
+	for (i=0; i < STROM_OBJCACHE_NSLOTS; i++)
 	{
-		struct gendisk	   *bd_disk = s_bdev->bd_disk;
+		strom_objcache_slot *oslot = &ocache->slots[i];
+		void	   *obj;
 
-		dtask->nvme_ns	= (struct nvme_ns *)bd_disk->private_data;
+		while ((obj = oslot->freelist) != NULL)
+		{
+			oslot->freelist = *((void **) obj);
+			kmem_cache_free(ocache->cachep, obj);
+		}
+		oslot->nitems = 0;
 	}
-
-	/* OK, this strom_dma_task is now tracked */
-	spin_lock_irqsave(&strom_dma_task_locks[dtask->hindex], flags);
-	list_add_rcu(&dtask->chain, &strom_dma_task_slots[dtask->hindex]);
-	spin_unlock_irqrestore(&strom_dma_task_locks[dtask->hindex], flags);
-
-	return dtask;
+	kmem_cache_destroy(ocache->cachep);
 }
 
 /*
- * strom_get_dma_task
+ * strom_objcache_alloc - returns an object with the leading @clearsz bytes
+ * zero-cleared
  */
-static strom_dma_task *
-strom_get_dma_task(strom_dma_task *dtask)
+static void *
+strom_objcache_alloc(strom_objcache *ocache, gfp_t gfp_mask)
 {
-	int		refcnt_new;
-
-	Assert(!dtask->frozen);
-	refcnt_new = atomic_inc_return(&dtask->refcnt);
-	Assert(refcnt_new > 1);
+	int			index = raw_smp_processor_id() % STROM_OBJCACHE_NSLOTS;
+	strom_objcache_slot *oslot = &ocache->slots[index];
+	unsigned long flags;
+	void	   *obj;
+
+	spin_lock_irqsave(&oslot->lock, flags);
+	obj = oslot->freelist;
+	if (obj)
+	{
+		oslot->freelist = *((void **) obj);
+		oslot->nitems--;
+	}
+	spin_unlock_irqrestore(&oslot->lock, flags);
 
-	return dtask;
-}
+	if (obj)
+	{
+		if (stat_info)
+			atomic64_inc(ocache->stat_nr_hit);
+	}
+	else
+	{
+		obj = kmem_cache_alloc(ocache->cachep, gfp_mask);
+		if (!obj)
+			return NULL;
+		if (stat_info)
+			atomic64_inc(ocache->stat_nr_miss);
+	}
+	memset(obj, 0, ocache->clearsz);
+	return obj;
+}
 
 /*
- * strom_put_dma_task
+ * strom_objcache_free - it may be called in interrupt context
  */
 static void
-strom_put_dma_task(strom_dma_task *dtask, long dma_status)
+strom_objcache_free(strom_objcache *ocache, void *obj)
 {
-	int					hindex = dtask->hindex;
-	unsigned long		flags = 0;
-	bool				has_spinlock = false;
+	int			index = raw_smp_processor_id() % STROM_OBJCACHE_NSLOTS;
+	strom_objcache_slot *oslot = &ocache->slots[index];
+	unsigned long flags;
 
-	if (unlikely(dma_status))
+	spin_lock_irqsave(&oslot->lock, flags);
+	if (oslot->nitems < ocache->slot_maxlen)
 	{
-		spin_lock_irqsave(&strom_dma_task_locks[hindex], flags);
-		if (!dtask->dma_status)
-			dtask->dma_status = dma_status;
-		has_spinlock = true;
+		*((void **) obj) = oslot->freelist;
+		oslot->freelist = obj;
+		oslot->nitems++;
+		obj = NULL;
 	}
+	spin_unlock_irqrestore(&oslot->lock, flags);
+	/* elsewhere, release to the kmem_cache */
+	if (obj)
+		kmem_cache_free(ocache->cachep, obj);
+}
 
-	if (atomic_dec_and_test(&dtask->refcnt))
-	{
-		mapped_gpu_memory  *mgmem = dtask->mgmem;
-		strom_dma_buffer   *sd_buf = dtask->sd_buf;
-		struct file		   *ioctl_filp = dtask->ioctl_filp;
-		struct file		   *data_filp = dtask->filp;
-		long				dma_status;
+/*
+ * strom_nvme_dev - run-time state of NVMe-SSD devices
+ *
+ * An entry is created on the first DMA request to the NVMe namespace, then
+ * kept until module unload. It pins the gendisk of the namespace, so that
+ * a namespace re-probed at the same address of struct nvme_ns always has
+ * another gendisk; then, the stale entry is retired from the hash and a
+ * new one is created, not to inherit @clk_ewma and @sgl_support. Commands
+ * in-flight may still refer the retired entry, so it is also released at
+ * module unload. @clk_ewma is the moving average of the TSC clocks per
+ * command (weight of the latest one is 1/8), to estimate the spin budget
+ * of hybrid polling. @sgl_support is the SGLS field of the
+ * identify controller data, if available. @nr_inflight is the number of
+ * our READ commands in-flight, to balance the reads over mirror legs.
+ * The rest are run-time statistics of the device, if stat_info is set;
+ * @vol_name is the md/dm volume where the last command came from, so
+ * nvme_stat can aggregate the members of a striped volume.
+ */
+typedef struct strom_nvme_dev
+{
+	struct list_head	chain;
+	struct list_head	retired_chain;
+	struct nvme_ns	   *nvme_ns;	/* key of the entry */
+	struct gendisk	   *disk;		/* pinned, to validate @nvme_ns */
+	char				disk_name[DISK_NAME_LEN];
+	u64					clk_ewma;	/* moving average of the latency */
+	bool				sgl_support;/* controller supports SGL */
+	atomic_t			nr_inflight;/* # of commands in-flight */
+	atomic_t			max_inflight;
+	atomic64_t			nr_cmds;
+	atomic64_t			nr_errors;
+	atomic64_t			bytes_read;
+	atomic64_t			clk_cmds;
+	struct gendisk	   *vol_disk;	/* only for comparison */
+	char				vol_name[DISK_NAME_LEN];
+} strom_nvme_dev;
+
+#define STROM_NVME_DEV_NSLOTS_BITS	6
+#define STROM_NVME_DEV_NSLOTS		(1UL << STROM_NVME_DEV_NSLOTS_BITS)
+static DEFINE_SPINLOCK(strom_nvme_dev_lock);
+static struct list_head	strom_nvme_dev_slots[STROM_NVME_DEV_NSLOTS];
+static LIST_HEAD(strom_nvme_dev_retired);
+
+static __init void
+strom_init_nvme_dev(void)
+{
+	int		i;
 
-		if (!has_spinlock)
-			spin_lock_irqsave(&strom_dma_task_locks[hindex], flags);
-		/* should be released after the final async job is submitted */
-		Assert(dtask->frozen);
-		/* fetch status under the lock */
-		dma_status = dtask->dma_status;
-		/* detach from the global hash table */
-		list_del_rcu(&dtask->chain);
-		/* move to the error task list, if any error */
-		if (unlikely(dma_status))
+	for (i=0; i < STROM_NVME_DEV_NSLOTS; i++)
+		INIT_LIST_HEAD(&strom_nvme_dev_slots[i]);
+}
+
+static void
+strom_exit_nvme_dev(void)
+{
+	strom_nvme_dev *ndev;
+	strom_nvme_dev *nnext;
+	int		i;
+
+	for (i=0; i < STROM_NVME_DEV_NSLOTS; i++)
+	{
+		list_for_each_entry_safe(ndev, nnext, &strom_nvme_dev_slots[i], chain)
 		{
-			dtask->ioctl_filp = NULL;
-			dtask->filp = NULL;
-			dtask->mgmem = NULL;
-			dtask->sd_buf = NULL;
-			list_add_tail_rcu(&dtask->chain, &failed_dma_task_slots[hindex]);
+			list_del(&ndev->chain);
+			put_device(disk_to_dev(ndev->disk));
+			kfree(ndev);
 		}
-		spin_unlock_irqrestore(&strom_dma_task_locks[hindex], flags);
-		/* wake up all the waiting tasks, if any */
-		wake_up_all(&strom_dma_task_waitq[hindex]);
+	}
+	list_for_each_entry_safe(ndev, nnext, &strom_nvme_dev_retired,
+							 retired_chain)
+	{
+		list_del(&ndev->retired_chain);
+		kfree(ndev);
+	}
+}
 
-		/* release the dtask object, if no error */
-		if (likely(!dma_status))
-			kfree(dtask);
-		if (mgmem)
-			strom_put_mapped_gpu_memory(mgmem);
-		if (sd_buf)
-			put_strom_dma_buffer(sd_buf);
-		fput(data_filp);
-		fput(ioctl_filp);
+/*
+ * strom_nvme_ctrl_sgl_support - checks SGLS field of the identify controller
+ * data. Bits 1:0 are 01b or 10b if SGL is supported for NVM command set.
+ * struct nvme_id_ctrl of RHEL7 kernel does not have the field, so we pick
+ * up the value by its offset.
+ */
+#define NVME_ID_CTRL_SGLS_OFFSET	536
 
-		prDebug("DMA task (id=%p) was completed", dtask);
-	}
-	else if (has_spinlock)
-		spin_unlock_irqrestore(&strom_dma_task_locks[hindex], flags);
+static bool
+strom_nvme_ctrl_sgl_support(struct nvme_ctrl *nvme_ctrl)
+{
+	struct nvme_id_ctrl *id_ctrl;
+	u32			sgls;
+
+	if (__nvme_identify_ctrl(nvme_ctrl, &id_ctrl) != 0)
+		return false;
+	sgls = le32_to_cpup((__le32 *)((char *)id_ctrl +
+								   NVME_ID_CTRL_SGLS_OFFSET));
+	kfree(id_ctrl);
+
+	return ((sgls & 0x0003) != 0);
 }
 
 /*
- * MD RAID-0 Support
+ * __strom_lookup_nvme_dev - lookup the entry of the NVMe namespace, or NULL
+ * if not created yet. Caller has to hold rcu_read_lock().
  */
-static inline struct strip_zone *
-find_zone(struct r0conf *conf, sector_t *p_sector)
+static strom_nvme_dev *
+__strom_lookup_nvme_dev(struct nvme_ns *nvme_ns)
 {
-	struct strip_zone  *zone = conf->strip_zone;
-	sector_t			sector = *p_sector;
-	int					i;
+	int					index = hash_64((u64)nvme_ns,
+										STROM_NVME_DEV_NSLOTS_BITS);
+	strom_nvme_dev	   *ndev;
 
-	for (i = 0; i < conf->nr_strip_zones; i++)
+	list_for_each_entry_rcu(ndev, &strom_nvme_dev_slots[index], chain)
 	{
-		if (sector < zone[i].zone_end) {
-			if (i)
-				*p_sector = sector - zone[i-1].zone_end;
-			return zone + i;
-		}
+		if (ndev->nvme_ns == nvme_ns &&
+			ACCESS_ONCE(ndev->disk) == nvme_ns->disk)
+			return ndev;
 	}
 	return NULL;
 }
 
-static struct nvme_ns *
-strom_raid0_map_sector(struct mddev *mddev,
-					   sector_t *p_sector,
-					   unsigned int nr_sects)
+/*
+ * strom_get_nvme_dev - lookup or create the entry of the NVMe namespace
+ */
+static strom_nvme_dev *
+strom_get_nvme_dev(struct nvme_ns *nvme_ns)
 {
-	struct r0conf	   *raid0_conf = mddev->private;
-	struct strip_zone  *zone;
-	struct md_rdev	   *rdev;
-	sector_t			sector = *p_sector;
-	sector_t			sector_offset = sector;
-	sector_t			chunk;
-	unsigned int		sect_in_chunk;
-	int					raid_disks = raid0_conf->strip_zone[0].nb_dev;
-	unsigned int		chunk_sects = mddev->chunk_sectors;
-
-	/*
-	 * Ensure (sector)...(sector + nr_sects) does not go across the chunk
-	 * boundary.
-	 */
-	if (sector / chunk_sects != (sector + nr_sects - 1) / chunk_sects)
-	{
-		prError("Bug? page-aligned i/o goes across boundary of md raid-0"
-				" (sector=%ld, nr_sect=%u, chunk_sects=%ld)",
-				(long)sector, nr_sects, (long)chunk_sects);
-		return ERR_PTR(-ESPIPE);
-	}
- 
-	zone = find_zone(raid0_conf, &sector_offset);
-	if (!zone)
+	int					index = hash_64((u64)nvme_ns,
+										STROM_NVME_DEV_NSLOTS_BITS);
+	struct list_head   *slot = &strom_nvme_dev_slots[index];
+	strom_nvme_dev	   *ndev;
+	strom_nvme_dev	   *temp;
+	struct gendisk	   *stale_disk = NULL;
+
+	rcu_read_lock();
+	ndev = __strom_lookup_nvme_dev(nvme_ns);
+	rcu_read_unlock();
+	if (ndev)
+		return ndev;
+
+	/* not found, so create a new one */
+	temp = kzalloc(sizeof(strom_nvme_dev), GFP_KERNEL);
+	if (!temp)
+		return NULL;
+	temp->nvme_ns = nvme_ns;
+	temp->disk = nvme_ns->disk;
+	get_device(disk_to_dev(temp->disk));
+	strlcpy(temp->disk_name, nvme_ns->disk->disk_name, DISK_NAME_LEN);
+	temp->clk_ewma = 0;
+	temp->sgl_support = strom_nvme_ctrl_sgl_support(nvme_ns->ctrl);
+	atomic_set(&temp->nr_inflight, 0);
+	atomic_set(&temp->max_inflight, 0);
+	atomic64_set(&temp->nr_cmds, 0);
+	atomic64_set(&temp->nr_errors, 0);
+	atomic64_set(&temp->bytes_read, 0);
+	atomic64_set(&temp->clk_cmds, 0);
+	temp->vol_disk = NULL;
+	temp->vol_name[0] = '\0';
+
+	spin_lock(&strom_nvme_dev_lock);
+	list_for_each_entry(ndev, slot, chain)
 	{
-		prError("sector='%lu': out of range in md raid-0 configuration",
-				*p_sector);
-		return ERR_PTR(-ERANGE);
+		if (ndev->nvme_ns != nvme_ns)
+			continue;
+		if (ndev->disk == nvme_ns->disk)
+		{
+			/* someone inserted concurrently */
+			spin_unlock(&strom_nvme_dev_lock);
+			put_device(disk_to_dev(temp->disk));
+			kfree(temp);
+			return ndev;
+		}
+		/* namespace was re-probed; retire the stale entry */
+		stale_disk = ndev->disk;
+		ACCESS_ONCE(ndev->disk) = NULL;
+		list_del_rcu(&ndev->chain);
+		list_add(&ndev->retired_chain, &strom_nvme_dev_retired);
+		break;
 	}
+	list_add_rcu(&temp->chain, slot);
+	spin_unlock(&strom_nvme_dev_lock);
+	if (stale_disk)
+		put_device(disk_to_dev(stale_disk));
 
-	if ((chunk_sects & (chunk_sects - 1)) == 0)		/* power of 2? */
-	{
-		int			chunksect_bits = ffz(~chunk_sects);
-		/* find the sector offset inside the chunk */
-		sect_in_chunk = sector & (chunk_sects - 1);
-		sector >>= chunksect_bits;
-		/* chunk in zone; quotient is the chunk in real device*/
-		chunk = sector_offset;
-		sector_div(chunk, zone->nb_dev << chunksect_bits);
-	}
-	else
-	{
-		sect_in_chunk = sector_div(sector, chunk_sects);
-		chunk = sector_offset;
-		sector_div(chunk, chunk_sects * zone->nb_dev);
-	}
-	sector_offset = (chunk * chunk_sects) + sect_in_chunk;
+	return temp;
+}
 
-	/*
-	 *  real sector = chunk in device + starting of zone
-	 *   + the position in the chunk
-	 */
-	rdev = raid0_conf->devlist[(zone - raid0_conf->strip_zone) * raid_disks
-							   + sector_div(sector, zone->nb_dev)];
+/*
+ * strom_update_nvme_dev_latency - it may be called in interrupt context;
+ * no lock is needed because it is just a hint.
+ */
+static inline void
+strom_update_nvme_dev_latency(strom_nvme_dev *ndev, u64 clocks)
+{
+	u64		clk_ewma = ACCESS_ONCE(ndev->clk_ewma);
 
-	sector_offset += zone->dev_start + rdev->data_offset;
-	if (rdev->bdev->bd_part)
-		sector_offset += rdev->bdev->bd_part->start_sect;
-	*p_sector = sector_offset;
+	if (clk_ewma == 0)
+		clk_ewma = clocks;
+	else
+		clk_ewma = clk_ewma - (clk_ewma >> 3) + (clocks >> 3);
+	ACCESS_ONCE(ndev->clk_ewma) = clk_ewma;
+}
 
-	return (struct nvme_ns *) rdev->bdev->bd_disk->private_data;
+/*
+ * strom_update_nvme_dev_volume - it remembers the md/dm volume where the
+ * command came from. Usually, it is the same one of the last command.
+ */
+static inline void
+strom_update_nvme_dev_volume(strom_nvme_dev *ndev, struct gendisk *vol_disk)
+{
+	if (ACCESS_ONCE(ndev->vol_disk) == vol_disk)
+		return;
+	spin_lock(&strom_nvme_dev_lock);
+	ndev->vol_disk = vol_disk;
+	if (vol_disk)
+		strlcpy(ndev->vol_name, vol_disk->disk_name, DISK_NAME_LEN);
+	else
+		ndev->vol_name[0] = '\0';
+	spin_unlock(&strom_nvme_dev_lock);
 }
 
 /*
- * MEMO: nvme_setup_prps() in the vanilla kernel will lead scalability problem
- * if large concurrent asynchronous DMA is issued. Core of the problem is
- * dma_pool_alloc() to setup PRPs (Physical Region Page) list for NVMe's READ
- * command. It tries to walk on a list of pre-allocated pages under spinlock.
- * Concurrent workload easily grows length of the list up, then duration of
- * the critical section makes longer.
- * In case of NVMe-Strom, length of PRPs list is about (128KB / PAGE_SIZE)
- * entries. So, we can pre-allocate fixed-length PRPs-list buffer, and we can
- * look-up inactive buffer with one step.
+ * strom_raid0_geom - lookup table of md-raid0 configuration
+ *
+ * find_zone() and map_sector() of the md-raid0 walk on the zones and chase
+ * the rdev of the member for each page. We precompute the zones and the
+ * namespace / starting sector of the members when the source file is
+ * looked up, then release the table with the strom_dma_source. The source
+ * file is referenced during the ioctl(2) call, so the members are never
+ * removed from the running array; the table is never kept across the
+ * calls, so a new configuration is always reflected on the next call.
  */
-struct strom_prps_item
+typedef struct strom_raid0_member
 {
-	struct list_head	chain;
-	dma_addr_t			pitem_dma;	/* physical address of this structure */
-	unsigned int		cpu_id;	/* index to strom_prps_locks/slots */
-	unsigned int		nrooms;	/* size of prps_list[] array */
-	unsigned int		nitems;	/* usage count of prps_list[] array */
-	__le64				prps_list[NVMESSD_DMAREQ_MAXSZ / PAGE_SIZE + 1];
-};
-typedef struct strom_prps_item		strom_prps_item;
-#define STROM_PRPS_ITEMS_NSLOTS		32
-static struct device   *strom_prps_device = NULL;
-static spinlock_t		strom_prps_locks[STROM_PRPS_ITEMS_NSLOTS];
-static struct list_head	strom_prps_slots[STROM_PRPS_ITEMS_NSLOTS];
+	struct nvme_ns	   *nvme_ns;
+	sector_t			start_sect;	/* data_offset + partition start */
+} strom_raid0_member;
 
-static __init int
-strom_find_pci_device(struct device *dev, void *data)
+typedef struct strom_raid0_zone
 {
-	struct pci_dev	   *pci_device = to_pci_dev(dev);
-    struct pci_driver  *nvme_driver = (struct pci_driver *) data;
+	sector_t			zone_start;	/* first sector of the zone */
+	sector_t			zone_end;	/* start of the next zone */
+	sector_t			dev_start;	/* zone offset in member devices */
+	int					nb_dev;		/* # of members in the zone */
+	strom_raid0_member *members;
+} strom_raid0_zone;
+
+typedef struct strom_raid0_geom
+{
+	unsigned int		chunk_sects;
+	int					chunk_shift;/* log2(chunk_sects), or -1 */
+	int					nr_members;	/* # of members of the first zone */
+	int					nr_zones;
+	strom_raid0_zone	zones[1];	/* members follow the zones */
+} strom_raid0_geom;
 
-	if (nvme_driver)
+/*
+ * strom_build_raid0_geom - build the table of md-raid0 device
+ */
+static strom_raid0_geom *
+strom_build_raid0_geom(struct mddev *mddev)
+{
+	struct r0conf	   *conf = mddev->private;
+	strom_raid0_geom   *temp;
+	strom_raid0_member *members;
+	int					nr_zones = conf->nr_strip_zones;
+	int					raid_disks = conf->strip_zone[0].nb_dev;
+	size_t				length;
+	int					i, j;
+
+	length = (offsetof(strom_raid0_geom, zones[nr_zones]) +
+			  sizeof(strom_raid0_member) * nr_zones * raid_disks);
+	temp = kzalloc(length, GFP_KERNEL);
+	if (!temp)
+		return NULL;
+	temp->chunk_sects = mddev->chunk_sectors;
+	if ((temp->chunk_sects & (temp->chunk_sects - 1)) == 0)
+		temp->chunk_shift = ffz(~temp->chunk_sects);
+	else
+		temp->chunk_shift = -1;
+	temp->nr_members = raid_disks;
+	temp->nr_zones = nr_zones;
+	members = (strom_raid0_member *)&temp->zones[nr_zones];
+	for (i=0; i < nr_zones; i++)
 	{
-		if (pci_device->driver == nvme_driver)
-			return 1;
-		return 0;
+		struct strip_zone  *szone = &conf->strip_zone[i];
+		strom_raid0_zone   *zone = &temp->zones[i];
+
+		zone->zone_start = (i > 0 ? conf->strip_zone[i-1].zone_end : 0);
+		zone->zone_end = szone->zone_end;
+		zone->dev_start = szone->dev_start;
+		zone->nb_dev = szone->nb_dev;
+		zone->members = members + i * raid_disks;
+		for (j=0; j < szone->nb_dev; j++)
+		{
+			struct md_rdev *rdev = conf->devlist[i * raid_disks + j];
+
+			zone->members[j].nvme_ns = (struct nvme_ns *)
+				rdev->bdev->bd_disk->private_data;
+			zone->members[j].start_sect = rdev->data_offset;
+			if (rdev->bdev->bd_part)
+				zone->members[j].start_sect += rdev->bdev->bd_part->start_sect;
+		}
 	}
-	return 1;
+	return temp;
 }
 
-static __init int
-strom_init_prps_item_buffer(void)
+/*
+ * strom_extent_cache - cache of the file-offset to device-block mapping
+ *
+ * A DMA task has its own cache, and it is valid only during the ioctl(2)
+ * call which builds the READ commands of the task. We cannot keep the
+ * mapping across the calls, because a file can be truncated then rewritten
+ * within a tick of the timestamps, and extents can be moved by the online
+ * defragmentation (EXT4_IOC_MOVE_EXT, xfs_fsr) without any change of the
+ * inode attributes visible here. During the call, the source files are
+ * referenced by the task, so the inode pointer is a stable key.
+ * Once the cache gets full, the oldest entry is replaced.
+ */
+#define STROM_EXTENT_CACHE_NITEMS	16		/* max extents per task */
+#define STROM_EXTENT_LOOKUP_MAXSZ	(256UL << 20)	/* 256MB */
+
+typedef struct strom_extent
 {
-    struct device_driver   *dev_driver;
-	int		i;
+	struct inode	   *inode;		/* owner of the extent */
+	sector_t			iblock;		/* head of the logical block */
+	sector_t			blocknr;	/* head of the device block */
+	unsigned int		nr_blocks;	/* length of the extent */
+} strom_extent;
 
-	/*
-	 * Try to acquire a PCI device which is likely NVMe-SSD.
-	 */
-	dev_driver = driver_find("nvme", &pci_bus_type);
-	if (dev_driver && dev_driver->owner == mod_nvme_alloc_request)
-	{
-		strom_prps_device = bus_find_device(&pci_bus_type, NULL,
-											to_pci_driver(dev_driver),
-											strom_find_pci_device);
-	}
-	if (!strom_prps_device)
-		strom_prps_device = bus_find_device(&pci_bus_type, NULL, NULL,
-											strom_find_pci_device);
-	if (!strom_prps_device)
-	{
-		prError("No PCI device found, thus unable to get entry to alloc/free coherent memory for DMA");
-		return -ENOENT;
-	}
+typedef struct strom_extent_cache
+{
+	int					nr_extents;
+	int					next_victim;
+	strom_extent		extents[STROM_EXTENT_CACHE_NITEMS];
+} strom_extent_cache;
 
-	/* init strom_prps_locks/slots */
-	for (i=0; i < STROM_PRPS_ITEMS_NSLOTS; i++)
+static inline void
+strom_extent_cache_reset(strom_extent_cache *ecache)
+{
+	ecache->nr_extents	= 0;
+	ecache->next_victim	= 0;
+}
+
+static void
+strom_extent_cache_insert(strom_extent_cache *ecache, strom_extent *extent)
+{
+	if (ecache->nr_extents < STROM_EXTENT_CACHE_NITEMS)
+		ecache->extents[ecache->nr_extents++] = *extent;
+	else
 	{
-		spin_lock_init(&strom_prps_locks[i]);
-		INIT_LIST_HEAD(&strom_prps_slots[i]);
+		ecache->extents[ecache->next_victim] = *extent;
+		ecache->next_victim = ((ecache->next_victim + 1) %
+							   STROM_EXTENT_CACHE_NITEMS);
 	}
-	return 0;
 }
 
-static void
-strom_exit_prps_item_buffer(void)
+/*
+ * strom_lookup_extent - maps the logical block of the file to the device
+ * block, and returns the number of the contiguous blocks from there.
+ * Unlike strom_get_block, it asks the filesystem for a long extent on the
+ * cache miss, so the following lookups on the same extent are cheap.
+ * If the block is a hole or unwritten extent, *p_is_hole is set; these
+ * blocks are never cached, because delayed allocation or conversion of
+ * the unwritten extent may happen on writeback even during the call.
+ */
+static int
+strom_lookup_extent(strom_extent_cache *ecache,
+					struct inode *inode, sector_t iblock,
+					sector_t *p_blocknr, unsigned int *p_nr_blocks,
+					bool *p_is_hole)
 {
-	int		index;
+	strom_extent		extent;
+	struct buffer_head	bh;
+	loff_t				i_size;
+	size_t				length;
+	int					i, retval;
 
-	for (index=0; index < STROM_PRPS_ITEMS_NSLOTS; index++)
+	for (i=0; i < ecache->nr_extents; i++)
 	{
-		spinlock_t		   *lock = &strom_prps_locks[index];
-		struct list_head   *slot = &strom_prps_slots[index];
-		unsigned long		flags;
-		strom_prps_item	   *pitem;
+		strom_extent   *curr = &ecache->extents[i];
 
-		spin_lock_irqsave(lock, flags);
-		while (!list_empty(slot))
+		if (curr->inode == inode &&
+			iblock >= curr->iblock &&
+			iblock <  curr->iblock + curr->nr_blocks)
 		{
-			pitem = list_first_entry(slot, strom_prps_item, chain);
-			list_del(&pitem->chain);
-			spin_unlock_irqrestore(lock, flags);
-
-			dma_free_coherent(strom_prps_device,
-							  sizeof(strom_prps_item),
-							  pitem,
-							  pitem->pitem_dma);
-			spin_lock_irqsave(lock, flags);
+			*p_blocknr   = curr->blocknr + (iblock - curr->iblock);
+			*p_nr_blocks = curr->nr_blocks - (iblock - curr->iblock);
+			*p_is_hole   = false;
+			if (stat_info)
+				atomic64_inc(&stat_nr_extent_cache_hit);
+			return 0;
 		}
-		spin_unlock_irqrestore(lock, flags);
 	}
-	put_device(strom_prps_device);
+	if (stat_info)
+		atomic64_inc(&stat_nr_extent_cache_miss);
+
+	/* ask the filesystem for the extent, up to the end of file */
+	i_size = i_size_read(inode);
+	length = STROM_EXTENT_LOOKUP_MAXSZ;
+	if (((loff_t)iblock << inode->i_blkbits) + length > i_size &&
+		((loff_t)iblock << inode->i_blkbits) < i_size)
+		length = i_size - ((loff_t)iblock << inode->i_blkbits);
+	length = round_up(length, 1UL << inode->i_blkbits);
+
+	memset(&bh, 0, sizeof(bh));
+	bh.b_size = length;
+	retval = strom_get_block(inode, iblock, &bh, 0);
+	if (retval)
+		return retval;
+	*p_blocknr = bh.b_blocknr;
+	*p_nr_blocks = 1;
+	*p_is_hole = false;
+
+	if (!buffer_mapped(&bh) || buffer_unwritten(&bh))
+	{
+		/*
+		 * Hole or unwritten extent. Length of the unmapped range is
+		 * reported by XFS, and ext4 for unwritten extents, but ext4 does
+		 * not update @b_size for holes.
+		 */
+		*p_blocknr = 0;
+		*p_is_hole = true;
+		if ((buffer_mapped(&bh) ||
+			 inode->i_sb->s_magic == XFS_SB_MAGIC) &&
+			(bh.b_size >> inode->i_blkbits) > 0)
+			*p_nr_blocks = (bh.b_size >> inode->i_blkbits);
+		return 0;
+	}
+	/* only regular mapped extents are cached */
+	if ((bh.b_size >> inode->i_blkbits) == 0)
+		return 0;
+	*p_nr_blocks = (bh.b_size >> inode->i_blkbits);
+	extent.inode	 = inode;
+	extent.iblock	 = iblock;
+	extent.blocknr	 = bh.b_blocknr;
+	extent.nr_blocks = bh.b_size >> inode->i_blkbits;
+	strom_extent_cache_insert(ecache, &extent);
+
+	return 0;
 }
 
-static strom_prps_item *
-strom_prps_item_alloc(void)
+/*
+ * strom_proc_state - per file descriptor state of "/proc/nvme-strom"
+ */
+struct strom_proc_state
 {
-	int					index = smp_processor_id() % STROM_PRPS_ITEMS_NSLOTS;
-	spinlock_t		   *lock = &strom_prps_locks[index];
-	struct list_head   *slot = &strom_prps_slots[index];
-	unsigned long		flags;
-	dma_addr_t			pitem_dma;
-	strom_prps_item	   *pitem;
+	spinlock_t			lock;		/* lock of the fields below */
+	struct idr			task_idr;	/* DMA tasks submitted on this file,
+									 * including the failed ones not yet
+									 * reclaimed */
+	wait_queue_head_t	waitq;		/* wake up on completion of any DMA
+									 * tasks submitted on this file */
+	unsigned int		nr_completed;/* bumped on completion of any DMA
+									 * tasks; hybrid polling spins on it
+									 * without the lock */
+	StromCompletionRing *cring;		/* completion ring, if any */
+	size_t				cring_sz;	/* allocated size of the @cring */
+	u32					cring_mask;	/* nr_entries - 1; we never trust the
+									 * 'mask' on the shared memory */
+	wait_queue_head_t	pollq;		/* poll(2) on the completion ring */
+	struct eventfd_ctx *eventfd;	/* signaled on completion, if any */
+};
+typedef struct strom_proc_state	strom_proc_state;
 
-	spin_lock_irqsave(lock, flags);
-	if (!list_empty(slot))
-	{
-		pitem = list_first_entry(slot, strom_prps_item, chain);
-		list_del(&pitem->chain);
-		memset(&pitem->chain, 0, sizeof(struct list_head));
-		spin_unlock_irqrestore(lock, flags);
-		return pitem;
+struct strom_dma_task
+{
+	unsigned long		dma_task_id;/* ID of this DMA task in the task_idr
+									 * of the @ioctl_filp */
+	atomic_t			refcnt;		/* reference counter */
+	bool				frozen;		/* (DEBUG) no longer newly referenced */
+	bool				failed;		/* completed with errors, and not yet
+									 * reclaimed */
+	bool				cancelled;	/* completion shall be dropped, without
+									 * error status nor ring entry */
+	mapped_gpu_memory  *mgmem;		/* destination GPU memory segment */
+	strom_dma_buffer   *sd_buf;		/* destination host mapped DMA buffer */
+	/* reference to the backing file */
+	struct file		   *filp;		/* source file */
+	/* other source files of the multi-file DMA task, if any */
+	struct file		  **extra_filps;
+	unsigned int		nr_extra_filps;
+	/* MD RAID configuration of the current source file, if any */
+	struct mddev	   *mddev;
+	/* lookup table of md-raid0, owned by the strom_dma_source; so valid
+	 * only during the ioctl(2) call */
+	struct strom_raid0_geom *raid0_geom;
+	/* device-mapper volume of the current source file, if any */
+	struct mapped_device *dm_md;
+	unsigned int		dm_target_hint;	/* index of the last dm target */
+	/* md/dm volume of the current source file, for statistics */
+	struct gendisk	   *vol_disk;
+	/* CPU copy of the cached pages, if partial-hybrid mode */
+	bool				copy_cached;
+	/* pending requests for each member of md-raid0, if any */
+	struct strom_stripe_slot *stripe_slots;
+	unsigned int		nr_stripe_slots;
+	/* current focus of the raw NVMe-SSD device */
+	struct nvme_ns	   *nvme_ns;	/* NVMe namespace (=SCSI LUN) */
+	/* device of the last submitted command, for hybrid polling */
+	strom_nvme_dev	   *ndev;
+	/* block mapping of the source files during submission */
+	strom_extent_cache	ecache;
+
+	/*
+	 * status of asynchronous tasks
+	 *
+	 * MEMO: Pay attention to error status of the asynchronous tasks.
+	 * Asynchronous task may cause errors on random timing, and kernel
+	 * space wants to inform this status on the next call. On the other
+	 * hands, application may invoke ioctl(2) to reference DMA results,
+	 * but may not. So, we have to keep an error status somewhere, but
+	 * also needs to be released on appropriate timing; to avoid kernel
+	 * memory leak by rude applications.
+	 * If any errors, we keep strom_dma_task structure in the task table
+	 * of file handler used for ioctl(2). The error status shall be
+	 * reclaimed on the next time when application wait for a particular
+	 * DMA task, or this file handler is closed.
+	 */
+	long				dma_status;
+	struct file		   *ioctl_filp;
+	/* true, if completion shall be posted to the ring of @ioctl_filp */
+	bool				post_cring;
+	unsigned int		nr_dma_submit;
+	unsigned int		nr_dma_blocks;
+
+	/* state of the current pending SSD2GPU DMA request */
+	loff_t				dest_offset;/* current destination offset */
+	sector_t			head_sector;
+	unsigned int		nr_sectors;
+	/* destination of the pending request, if not contiguous */
+	struct strom_dest_run *dest_runs;
+	unsigned int		nr_dest_runs;
+	/*
+	 * NOTE: fields below are not cleared on allocation; see strom_objcache
+	 */
+	/* temporary buffer for locked page cache in a chunk */
+	struct page		   *file_pages[NVMESSD_DMAREQ_MAXSZ / PAGE_CACHE_SIZE];
+	/* location of the file pages in a chunk, mapped prior to submission */
+	struct nvme_ns	   *file_nvme_ns[NVMESSD_DMAREQ_MAXSZ / PAGE_CACHE_SIZE];
+	sector_t			file_sectors[NVMESSD_DMAREQ_MAXSZ / PAGE_CACHE_SIZE];
+};
+typedef struct strom_dma_task	strom_dma_task;
+
+/*
+ * strom_dest_run - a contiguous range of the destination buffer. A request
+ * of the physically sorted SSD2RAM may scatter the blocks to multiple runs.
+ * @dest_offset == -1 means the gap between runs; these blocks are read into
+ * the strom_scratch_page, then discarded.
+ */
+typedef struct strom_dest_run
+{
+	loff_t				dest_offset;
+	unsigned int		nr_pages;
+} strom_dest_run;
+
+/*
+ * strom_stripe_slot - pending request on a member device of md-raid0. See
+ * memcpy_from_raid0_striped().
+ */
+typedef struct strom_stripe_slot
+{
+	struct nvme_ns	   *nvme_ns;	/* member device, or NULL if unused */
+	bool				scatter;	/* dest_runs can scatter by page */
+	sector_t			head_sector;
+	unsigned int		nr_sectors;
+	unsigned int		nr_dest_runs;
+	strom_dest_run	   *dest_runs;
+} strom_stripe_slot;
+#define STROM_STRIPE_MAX_SLOTS		32
+
+/*
+ * strom_dma_task_waiter - an entry of the waitq of strom_proc_state
+ *
+ * Waitq is shared by all the tasks submitted on the same file, so completion
+ * of a DMA task wakes up the waiters with its dma_task_id as a key, then
+ * strom_dma_task_wake_function() ignores the waiters for other tasks.
+ * Waiters of STROM_IOCTL__MEMCPY_WAIT_MULTI use the default wake function,
+ * so they are woken up on any completion.
+ */
+typedef struct strom_dma_task_waiter
+{
+	wait_queue_t		wait;
+	unsigned long		dma_task_id;
+} strom_dma_task_waiter;
+
+static int
+strom_dma_task_wake_function(wait_queue_t *wait, unsigned mode,
+							 int sync, void *key)
+{
+	strom_dma_task_waiter *waiter
+		= container_of(wait, strom_dma_task_waiter, wait);
+
+	if (waiter->dma_task_id != (unsigned long) key)
+		return 0;
+	return autoremove_wake_function(wait, mode, sync, key);
+}
+
+#define DEFINE_DMA_TASK_WAITER(name, __dma_task_id)				\
+	strom_dma_task_waiter name = {								\
+		.wait = {												\
+			.private	= current,								\
+			.func		= strom_dma_task_wake_function,			\
+			.task_list	= LIST_HEAD_INIT((name).wait.task_list),\
+		},														\
+		.dma_task_id	= (__dma_task_id),						\
+	}
+
+/*
+ * strom_dma_source - a source file which is already checked by
+ * file_is_supported_nvme(). STROM_IOCTL__MEMCPY_BATCH reuses it for the
+ * consecutive commands on the same file descriptor, to skip fget() and
+ * the filesystem / device checks for each command.
+ */
+typedef struct strom_dma_source
+{
+	int					fdesc;		/* file descriptor, or -1 if empty */
+	struct file		   *filp;		/* source file */
+	struct mddev	   *mddev;		/* MD RAID configuration, if any */
+	strom_raid0_geom   *raid0_geom;	/* lookup table, if md-raid0 */
+	struct mapped_device *dm_md;	/* device-mapper volume, if any */
+} strom_dma_source;
+
+static inline void
+strom_init_dma_source(strom_dma_source *dsrc)
+{
+	dsrc->fdesc	= -1;
+	dsrc->filp	= NULL;
+	dsrc->mddev	= NULL;
+	dsrc->raid0_geom = NULL;
+	dsrc->dm_md	= NULL;
+}
+
+/*
+ * strom_put_dma_source
+ */
+static void
+strom_put_dma_source(strom_dma_source *dsrc)
+{
+	if (dsrc->filp)
+		fput(dsrc->filp);
+	kfree(dsrc->raid0_geom);
+	strom_init_dma_source(dsrc);
+}
+
+/*
+ * strom_get_dma_source - it looks up the source file by the file descriptor,
+ * unless @dsrc already holds the same one.
+ */
+static int
+strom_get_dma_source(strom_dma_source *dsrc, int fdesc)
+{
+	struct file		   *filp;
+	struct mddev	   *mddev = NULL;
+	strom_raid0_geom   *raid0_geom = NULL;
+	struct mapped_device *dm_md = NULL;
+	int					node_id = -2;
+	int					support_dma64 = 1;
+	int					retval;
+
+	if (dsrc->filp && dsrc->fdesc == fdesc)
+		return 0;
+	strom_put_dma_source(dsrc);
+
+	/* ensure the source file is supported */
+	filp = fget(fdesc);
+	if (!filp)
+	{
+		prError("file descriptor %d of process %u is not available",
+				fdesc, current->tgid);
+		return -EBADF;
+	}
+	retval = file_is_supported_nvme(filp,
+									&node_id,
+									&support_dma64,
+									&mddev,
+									&dm_md);
+	if (retval < 0)
+	{
+		fput(filp);
+		return retval;
+	}
+	if (mddev && mddev->level == 0)
+	{
+		raid0_geom = strom_build_raid0_geom(mddev);
+		if (!raid0_geom)
+		{
+			fput(filp);
+			return -ENOMEM;
+		}
+	}
+	dsrc->fdesc	= fdesc;
+	dsrc->filp	= filp;
+	dsrc->mddev	= mddev;
+	dsrc->raid0_geom = raid0_geom;
+	dsrc->dm_md	= dm_md;
+
+	return 0;
+}
+
+/*
+ * strom_create_dma_task
+ */
+static strom_dma_task *
+strom_create_dma_task(strom_dma_source *dsrc,
+					  mapped_gpu_memory *mgmem,
+					  struct strom_dma_buffer *sd_buf,
+					  struct file *ioctl_filp)
+{
+	strom_proc_state	   *pstate = ioctl_filp->private_data;
+	strom_dma_task		   *dtask;
+	struct file			   *filp = dsrc->filp;
+	struct block_device	   *s_bdev = strom_file_bdev(filp);
+	unsigned long			flags;
+	int						id;
+
+	/* either of GPU or Host memory can be destination */
+	Assert((mgmem != NULL && sd_buf == NULL) ||
+		   (mgmem == NULL && sd_buf != NULL));
+
+	/* allocate strom_dma_task object */
+	dtask = strom_objcache_alloc(&strom_dma_task_cache, GFP_KERNEL);
+	if (!dtask)
+		return ERR_PTR(-ENOMEM);
+	dtask->dma_task_id	= 0;		/* to be set later */
+    atomic_set(&dtask->refcnt, 1);
+	dtask->frozen		= false;
+	dtask->failed		= false;
+	dtask->cancelled	= false;
+    dtask->mgmem		= mgmem;
+	dtask->sd_buf		= sd_buf;
+    dtask->filp			= get_file(filp);
+	dtask->extra_filps	= NULL;
+	dtask->nr_extra_filps = 0;
+	dtask->mddev		= dsrc->mddev;
+	dtask->raid0_geom	= dsrc->raid0_geom;
+	dtask->dm_md		= dsrc->dm_md;
+	dtask->dm_target_hint = 0;
+	dtask->vol_disk		= (dsrc->mddev || dsrc->dm_md
+						   ? s_bdev->bd_disk : NULL);
+	dtask->copy_cached	= false;
+	dtask->stripe_slots	= NULL;
+	dtask->nr_stripe_slots = 0;
+	dtask->nvme_ns		= NULL;		/* to be set later */
+	strom_extent_cache_reset(&dtask->ecache);
+    dtask->dma_status	= 0;
+    dtask->ioctl_filp	= get_file(ioctl_filp);
+	dtask->post_cring	= false;	/* to be set on submission */
+	dtask->nr_dma_submit = 0;
+	dtask->nr_dma_blocks = 0;
+	dtask->dest_offset	= 0;
+	dtask->head_sector	= 0;
+	dtask->nr_sectors	= 0;
+
+	/*
+	 * If no MD RAID or device-mapper configuration here, the focused
+	 * NVMe-SSD will not be changed during execution. So, we setup nvme_ns
+	 * here.
+	 */
+	if (!dtask->mddev && !dtask->dm_md)
+	{
+		struct gendisk	   *bd_disk = s_bdev->bd_disk;
+
+		dtask->nvme_ns	= (struct nvme_ns *)bd_disk->private_data;
+	}
+
+	/*
+	 * OK, this strom_dma_task is now tracked. ID is assigned cyclically,
+	 * not to reuse the ID of recently completed task soon.
+	 */
+	idr_preload(GFP_KERNEL);
+	spin_lock_irqsave(&pstate->lock, flags);
+	id = idr_alloc_cyclic(&pstate->task_idr, dtask, 1, 0, GFP_NOWAIT);
+	spin_unlock_irqrestore(&pstate->lock, flags);
+	idr_preload_end();
+	if (id < 0)
+	{
+		fput(dtask->filp);
+		fput(dtask->ioctl_filp);
+		strom_objcache_free(&strom_dma_task_cache, dtask);
+		return ERR_PTR(id);
+	}
+	dtask->dma_task_id	= id;
+
+	return dtask;
+}
+
+/*
+ * strom_get_dma_task
+ */
+static strom_dma_task *
+strom_get_dma_task(strom_dma_task *dtask)
+{
+	int		refcnt_new;
+
+	Assert(!dtask->frozen);
+	refcnt_new = atomic_inc_return(&dtask->refcnt);
+	Assert(refcnt_new > 1);
+
+	return dtask;
+}
+
+/*
+ * strom_post_dma_completion - post completion of the DMA task to the ring
+ * of the file descriptor where it was submitted. It returns false if ring
+ * is full. Caller must hold pstate->lock.
+ */
+static bool
+strom_post_dma_completion(strom_proc_state *pstate,
+						  strom_dma_task *dtask, long dma_status)
+{
+	StromCompletionRing *cring;
+	StromCompletionEntry *centry;
+	u32					head, tail;
+	bool				retval = false;
+
+	cring = pstate->cring;
+	head = ACCESS_ONCE(cring->head);
+	tail = cring->tail;
+	if (tail - head > pstate->cring_mask)
+		cring->nr_overflow++;
+	else
+	{
+		centry = &cring->entries[tail & pstate->cring_mask];
+		centry->dma_task_id		= dtask->dma_task_id;
+		centry->status			= dma_status;
+		centry->nr_dma_submit	= dtask->nr_dma_submit;
+		centry->nr_dma_blocks	= dtask->nr_dma_blocks;
+		/* entry must be visible prior to the new tail */
+		smp_wmb();
+		cring->tail = tail + 1;
+		retval = true;
+	}
+	return retval;
+}
+
+/*
+ * strom_put_dma_task
+ */
+static void
+strom_put_dma_task(strom_dma_task *dtask, long dma_status)
+{
+	strom_proc_state   *pstate = dtask->ioctl_filp->private_data;
+	unsigned long		flags = 0;
+	bool				has_spinlock = false;
+
+	if (unlikely(dma_status))
+	{
+		spin_lock_irqsave(&pstate->lock, flags);
+		if (!dtask->dma_status)
+			dtask->dma_status = dma_status;
+		has_spinlock = true;
+	}
+
+	if (atomic_dec_and_test(&dtask->refcnt))
+	{
+		mapped_gpu_memory  *mgmem = dtask->mgmem;
+		strom_dma_buffer   *sd_buf = dtask->sd_buf;
+		struct file		   *ioctl_filp = dtask->ioctl_filp;
+		struct file		   *data_filp = dtask->filp;
+		struct file		  **extra_filps = dtask->extra_filps;
+		unsigned int		nr_extra_filps = dtask->nr_extra_filps;
+		unsigned long		dma_task_id = dtask->dma_task_id;
+		long				dma_status;
+		bool				posted = false;
+
+		if (!has_spinlock)
+			spin_lock_irqsave(&pstate->lock, flags);
+		/* should be released after the final async job is submitted */
+		Assert(dtask->frozen);
+		/* fetch status under the lock */
+		dma_status = dtask->dma_status;
+		/*
+		 * post completion to the ring, if any. Once error status gets
+		 * delivered via the ring, we don't need to keep the task.
+		 * Nobody is interested in the cancelled task.
+		 */
+		if (dtask->cancelled)
+			dma_status = 0;
+		else if (dtask->post_cring &&
+				 strom_post_dma_completion(pstate, dtask, dma_status))
+		{
+			posted = true;
+			dma_status = 0;
+		}
+		/* detach from the task table, or keep it as an error task */
+		if (likely(!dma_status))
+			idr_remove(&pstate->task_idr, dma_task_id);
+		else
+		{
+			dtask->failed = true;
+			dtask->ioctl_filp = NULL;
+			dtask->filp = NULL;
+			dtask->extra_filps = NULL;
+			dtask->nr_extra_filps = 0;
+			dtask->mgmem = NULL;
+			dtask->sd_buf = NULL;
+		}
+		ACCESS_ONCE(pstate->nr_completed) = pstate->nr_completed + 1;
+		/* notify the attached eventfd, if any */
+		if (pstate->eventfd)
+			eventfd_signal(pstate->eventfd, 1);
+		spin_unlock_irqrestore(&pstate->lock, flags);
+		/* wake up the waiting tasks for this DMA task, if any */
+		__wake_up(&pstate->waitq, TASK_NORMAL, 0, (void *) dma_task_id);
+		if (posted && waitqueue_active(&pstate->pollq))
+			wake_up_interruptible_poll(&pstate->pollq, POLLIN | POLLRDNORM);
+
+		/* release the dtask object, if no error */
+		if (likely(!dma_status))
+			strom_objcache_free(&strom_dma_task_cache, dtask);
+		if (mgmem)
+			strom_put_mapped_gpu_memory(mgmem);
+		if (sd_buf)
+			put_strom_dma_buffer(sd_buf);
+		fput(data_filp);
+		while (nr_extra_filps > 0)
+			fput(extra_filps[--nr_extra_filps]);
+		kfree(extra_filps);
+		fput(ioctl_filp);
+
+		prDebug("DMA task (id=%lu) was completed", dma_task_id);
+	}
+	else if (has_spinlock)
+		spin_unlock_irqrestore(&pstate->lock, flags);
+}
+
+/*
+ * strom_setup_dma_completion - it saves the results of submission, to be
+ * posted to the completion ring. If submission failed, caller synchronizes
+ * the task by itself, so we don't post it.
+ */
+static inline void
+strom_setup_dma_completion(strom_dma_task *dtask,
+						   unsigned int nr_dma_submit,
+						   unsigned int nr_dma_blocks,
+						   int submit_status)
+{
+	strom_proc_state   *pstate = dtask->ioctl_filp->private_data;
+
+	dtask->nr_dma_submit = nr_dma_submit;
+	dtask->nr_dma_blocks = nr_dma_blocks;
+	dtask->post_cring = (submit_status == 0 &&
+						 ACCESS_ONCE(pstate->cring) != NULL);
+}
+
+/*
+ * MD RAID-0 Support
+ */
+static inline strom_raid0_zone *
+find_zone(strom_raid0_geom *geom, sector_t *p_sector)
+{
+	strom_raid0_zone   *zone = geom->zones;
+	sector_t			sector = *p_sector;
+	int					lo = 0;
+	int					hi = geom->nr_zones;
+
+	/* binary search on the zones; usually only one or two */
+	while (lo < hi)
+	{
+		int		mid = (lo + hi) / 2;
+
+		if (sector < zone[mid].zone_end)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	if (lo >= geom->nr_zones)
+		return NULL;
+	*p_sector = sector - zone[lo].zone_start;
+	return zone + lo;
+}
+
+static struct nvme_ns *
+strom_raid0_map_sector(strom_raid0_geom *geom,
+					   sector_t *p_sector,
+					   unsigned int nr_sects)
+{
+	strom_raid0_zone   *zone;
+	strom_raid0_member *member;
+	sector_t			sector = *p_sector;
+	sector_t			sector_offset = sector;
+	sector_t			chunk;
+	unsigned int		sect_in_chunk;
+	unsigned int		chunk_sects = geom->chunk_sects;
+
+	/*
+	 * Ensure (sector)...(sector + nr_sects) does not go across the chunk
+	 * boundary.
+	 */
+	if (sector / chunk_sects != (sector + nr_sects - 1) / chunk_sects)
+	{
+		prError("Bug? page-aligned i/o goes across boundary of md raid-0"
+				" (sector=%ld, nr_sect=%u, chunk_sects=%ld)",
+				(long)sector, nr_sects, (long)chunk_sects);
+		return ERR_PTR(-ESPIPE);
+	}
+
+	zone = find_zone(geom, &sector_offset);
+	if (!zone)
+	{
+		prError("sector='%lu': out of range in md raid-0 configuration",
+				*p_sector);
+		return ERR_PTR(-ERANGE);
+	}
+
+	if (geom->chunk_shift >= 0)		/* power of 2? */
+	{
+		int			chunksect_bits = geom->chunk_shift;
+		/* find the sector offset inside the chunk */
+		sect_in_chunk = sector & (chunk_sects - 1);
+		sector >>= chunksect_bits;
+		/* chunk in zone; quotient is the chunk in real device*/
+		chunk = sector_offset;
+		sector_div(chunk, zone->nb_dev << chunksect_bits);
+	}
+	else
+	{
+		sect_in_chunk = sector_div(sector, chunk_sects);
+		chunk = sector_offset;
+		sector_div(chunk, chunk_sects * zone->nb_dev);
+	}
+	sector_offset = (chunk * chunk_sects) + sect_in_chunk;
+
+	/*
+	 *  real sector = chunk in device + starting of zone
+	 *   + the position in the chunk
+	 */
+	member = &zone->members[sector_div(sector, zone->nb_dev)];
+	*p_sector = sector_offset + zone->dev_start + member->start_sect;
+
+	return member->nvme_ns;
+}
+
+/*
+ * strom_mirror_find_rdev - lookup the member device by its role in the
+ * array. Caller has to hold rcu_read_lock().
+ */
+static struct md_rdev *
+strom_mirror_find_rdev(struct mddev *mddev, int raid_disk)
+{
+	struct md_rdev *rdev;
+
+	rdev_for_each_rcu(rdev, mddev)
+	{
+		if (rdev->raid_disk == raid_disk)
+			return rdev;
+	}
+	return NULL;
+}
+
+/*
+ * strom_mirror_rdev_start - head sector of the data area of the mirror leg
+ * on the underlying NVMe namespace.
+ */
+static inline sector_t
+strom_mirror_rdev_start(struct md_rdev *rdev)
+{
+	sector_t	start = rdev->data_offset;
+
+	if (rdev->bdev->bd_part)
+		start += rdev->bdev->bd_part->start_sect;
+	return start;
+}
+
+/*
+ * strom_mirror_unpin_rdev - equivalent to rdev_dec_pending() of md. Once
+ * the last command on the faulty leg gets completed, md thread is waken up
+ * to remove the leg.
+ */
+static void
+strom_mirror_unpin_rdev(struct md_rdev *rdev)
+{
+	struct mddev   *mddev = rdev->mddev;
+	bool			faulty = test_bit(Faulty, &rdev->flags);
+
+	if (atomic_dec_and_test(&rdev->nr_pending) && faulty)
+	{
+		set_bit(MD_RECOVERY_NEEDED, &mddev->recovery);
+		__md_wakeup_thread(mddev->thread);
+	}
+}
+
+/*
+ * strom_mirror_pin_rdev - pins the mirror leg by its role in the array, as
+ * read_balance() of md does for its own READ requests. md never removes
+ * the leg with commands in-flight, until strom_mirror_unpin_rdev().
+ * It returns NULL if the leg is faulty or not in-sync.
+ */
+static struct md_rdev *
+strom_mirror_pin_rdev(struct mddev *mddev, int raid_disk)
+{
+	struct md_rdev *rdev;
+
+	rcu_read_lock();
+	rdev = strom_mirror_find_rdev(mddev, raid_disk);
+	if (rdev &&
+		test_bit(In_sync, &rdev->flags) &&
+		!test_bit(Faulty, &rdev->flags))
+	{
+		atomic_inc(&rdev->nr_pending);
+		/* the leg may get faulty concurrently */
+		if (test_bit(Faulty, &rdev->flags))
+		{
+			strom_mirror_unpin_rdev(rdev);
+			rdev = NULL;
+		}
+	}
+	else
+		rdev = NULL;
+	rcu_read_unlock();
+
+	return rdev;
+}
+
+/*
+ * strom_mirror_pin_leg - pins the mirror leg where the READ command of
+ * @nr_sects from @sector on @nvme_ns goes to.
+ */
+static struct md_rdev *
+strom_mirror_pin_leg(struct mddev *mddev,
+					 struct nvme_ns *nvme_ns,
+					 sector_t sector,
+					 unsigned int nr_sects)
+{
+	struct md_rdev *rdev;
+	sector_t		start;
+	int				raid_disk = -1;
+
+	rcu_read_lock();
+	rdev_for_each_rcu(rdev, mddev)
+	{
+		if (rdev->raid_disk < 0 ||
+			rdev->bdev->bd_disk->private_data != nvme_ns)
+			continue;
+		start = strom_mirror_rdev_start(rdev);
+		if (sector >= start && sector + nr_sects <= start + rdev->sectors)
+		{
+			raid_disk = rdev->raid_disk;
+			break;
+		}
+	}
+	rcu_read_unlock();
+	if (raid_disk < 0)
+		return NULL;
+	return strom_mirror_pin_rdev(mddev, raid_disk);
+}
+
+/*
+ * strom_mirror_retry_leg - pins another mirror leg that has the copy of
+ * @nr_sects from *p_sector on the failed leg @rdev, then *p_sector is
+ * updated to the location on the new leg. Legs in @failed_legs (bitmap
+ * of the role in the array) are skipped. Copies of md-raid10 are resolved
+ * by the position of the chunk in the near layout, like
+ * strom_mirror_map_sector(); so the command must not go across the chunk
+ * boundary. It returns NULL if no other leg is available.
+ */
+static struct md_rdev *
+strom_mirror_retry_leg(struct md_rdev *rdev,
+					   unsigned long failed_legs,
+					   sector_t *p_sector,
+					   unsigned int nr_sects)
+{
+	struct mddev   *mddev = rdev->mddev;
+	struct md_rdev *__rdev;
+	sector_t		rel_sector = *p_sector - strom_mirror_rdev_start(rdev);
+	sector_t		__rel_sector;
+	sector_t		stripe = 0;
+	unsigned int	chunk_sects = mddev->chunk_sectors;
+	int				chunk_shift = 0;
+	int				raid_disks = mddev->raid_disks;
+	int				nr_copies;
+	int				dev, n;
+
+	if (raid_disks > BITS_PER_LONG)
+		return NULL;
+	if (mddev->level == 1)
+		nr_copies = raid_disks;
+	else
+	{
+		if (rel_sector / chunk_sects !=
+			(rel_sector + nr_sects - 1) / chunk_sects)
+			return NULL;
+		chunk_shift = ffz(~chunk_sects);
+		nr_copies = (mddev->layout & 0xff);
+		/* head of the copies of the chunk */
+		stripe = (rel_sector >> chunk_shift) * raid_disks + rdev->raid_disk;
+		sector_div(stripe, nr_copies);
+		stripe *= nr_copies;
+	}
+
+	for (n=0; n < nr_copies; n++)
+	{
+		__rel_sector = rel_sector;
+		if (mddev->level == 1)
+			dev = n;
+		else
+		{
+			sector_t	__stripe = stripe + n;
+
+			dev = sector_div(__stripe, raid_disks);
+			__rel_sector = ((__stripe << chunk_shift) +
+							(rel_sector & (chunk_sects - 1)));
+		}
+		if (dev == rdev->raid_disk || test_bit(dev, &failed_legs))
+			continue;
+		__rdev = strom_mirror_pin_rdev(mddev, dev);
+		if (!__rdev)
+			continue;
+		if (__rel_sector + nr_sects > __rdev->sectors)
+		{
+			strom_mirror_unpin_rdev(__rdev);
+			continue;
+		}
+		*p_sector = __rel_sector + strom_mirror_rdev_start(__rdev);
+		return __rdev;
+	}
+	return NULL;
+}
+
+/*
+ * strom_mirror_map_sector - maps the sector of md-raid1, or md-raid10 with
+ * near layout, to one of the mirror legs. Faulty or not-in-sync legs are
+ * skipped, and write-mostly legs are used only if no other leg is valid.
+ * If the sector is contiguous to the pending request of @dtask on one of
+ * the legs, it sticks to the leg to keep the READ command large.
+ * Elsewhere, it picks up the leg with the least commands in-flight, by
+ * both of NVMe-Strom and md itself. Unless the array is clean, the first
+ * valid leg is always used, like read_balance() of md during resync.
+ * The leg is pinned when the READ command is submitted, by
+ * strom_mirror_pin_leg().
+ * The logic to map block number of RAID-10 is equivalent to the near
+ * copies of __raid10_find_phys() at drivers/md/raid10.c.
+ */
+static struct nvme_ns *
+strom_mirror_map_sector(strom_dma_task *dtask,
+						struct mddev *mddev,
+						sector_t *p_sector,
+						unsigned int nr_sects)
+{
+	struct md_rdev	   *rdev;
+	struct nvme_ns	   *nvme_ns;
+	struct nvme_ns	   *best_ns = NULL;
+	sector_t			best_sector = 0;
+	int					best_load = INT_MAX;
+	struct nvme_ns	   *wm_ns = NULL;
+	sector_t			wm_sector = 0;
+	sector_t			sector = *p_sector;
+	sector_t			dev_sector;
+	unsigned int		chunk_sects = mddev->chunk_sectors;
+	bool				balance = (mddev->recovery_cp == MaxSector);
+	int					raid_disks = mddev->raid_disks;
+	int					nr_copies;
+	int					dev, n;
+
+	if (mddev->level == 1)
+	{
+		nr_copies = raid_disks;
+		dev = 0;
+	}
+	else
+	{
+		int			chunk_shift = ffz(~chunk_sects);
+		sector_t	stripe;
+
+		/*
+		 * Ensure (sector)...(sector + nr_sects) does not go across the
+		 * chunk boundary.
+		 */
+		if (sector / chunk_sects != (sector + nr_sects - 1) / chunk_sects)
+		{
+			prError("Bug? page-aligned i/o goes across boundary of md raid-10"
+					" (sector=%ld, nr_sect=%u, chunk_sects=%ld)",
+					(long)sector, nr_sects, (long)chunk_sects);
+			return ERR_PTR(-ESPIPE);
+		}
+		nr_copies = (mddev->layout & 0xff);
+		stripe = (sector >> chunk_shift) * nr_copies;
+		dev = sector_div(stripe, raid_disks);
+		sector = (stripe << chunk_shift) + (sector & (chunk_sects - 1));
+	}
+
+	rcu_read_lock();
+	for (n=0; n < nr_copies; n++)
+	{
+		rdev = strom_mirror_find_rdev(mddev, dev);
+		if (rdev &&
+			test_bit(In_sync, &rdev->flags) &&
+			!test_bit(Faulty, &rdev->flags))
+		{
+			strom_nvme_dev *ndev;
+			int			load;
+
+			nvme_ns = (struct nvme_ns *)rdev->bdev->bd_disk->private_data;
+			dev_sector = sector + strom_mirror_rdev_start(rdev);
+
+			if (dtask->nr_sectors > 0 &&
+				dtask->nvme_ns == nvme_ns &&
+				dtask->head_sector + dtask->nr_sectors == dev_sector)
+			{
+				best_ns = nvme_ns;
+				best_sector = dev_sector;
+				break;
+			}
+			ndev = __strom_lookup_nvme_dev(nvme_ns);
+			load = atomic_read(&rdev->nr_pending);
+			if (ndev)
+				load += atomic_read(&ndev->nr_inflight);
+			if (test_bit(WriteMostly, &rdev->flags))
+			{
+				if (!wm_ns)
+				{
+					wm_ns = nvme_ns;
+					wm_sector = dev_sector;
+				}
+			}
+			else if (!best_ns || (balance && load < best_load))
+			{
+				best_ns = nvme_ns;
+				best_sector = dev_sector;
+				best_load = load;
+			}
+		}
+		/* next copy is on the next device */
+		if (++dev >= raid_disks)
+		{
+			dev = 0;
+			sector += chunk_sects;
+		}
+	}
+	rcu_read_unlock();
+
+	if (!best_ns)
+	{
+		best_ns = wm_ns;
+		best_sector = wm_sector;
+	}
+	if (!best_ns)
+	{
+		prError("sector='%lu': no valid mirror in md raid-%d configuration",
+				*p_sector, mddev->level);
+		return ERR_PTR(-EIO);
+	}
+	*p_sector = best_sector;
+	return best_ns;
+}
+
+/*
+ * Device-mapper (linear/striped) Support
+ *
+ * The logic to map the sector is equivalent to linear_map_sector() at
+ * drivers/md/dm-linear.c and stripe_map_sector() at drivers/md/dm-stripe.c.
+ * The live table is looked up for each page, because it may be reloaded
+ * (e.g, lvextend) while the file is opened. Consecutive pages mostly hit
+ * the same target, so the index of the last target is kept in
+ * *p_target_hint, and it is tried prior to the binary search.
+ */
+static struct nvme_ns *
+strom_dm_map_sector(struct mapped_device *md,
+					unsigned int *p_target_hint,
+					sector_t *p_sector,
+					unsigned int nr_sects)
+{
+	struct dm_table	   *map;
+	struct dm_target   *ti = NULL;
+	struct dm_dev	   *ddev;
+	struct block_device *bdev;
+	struct nvme_ns	   *nvme_ns;
+	sector_t			sector = *p_sector;
+	sector_t			offset;
+	unsigned int		nr_targets;
+	unsigned int		lo, hi, mid;
+	int					srcu_idx;
+
+	map = __dm_get_live_table(md, &srcu_idx);
+	if (!map)
+	{
+		prError("dm-device has no active table");
+		nvme_ns = ERR_PTR(-ENODEV);
+		goto out;
+	}
+
+	nr_targets = __dm_table_get_num_targets(map);
+	if (*p_target_hint < nr_targets)
+	{
+		ti = __dm_table_get_target(map, *p_target_hint);
+		if (sector < ti->begin || sector >= ti->begin + ti->len)
+			ti = NULL;
+	}
+	if (!ti)
+	{
+		/* binary search on the targets; they are sorted by the sector */
+		lo = 0;
+		hi = nr_targets;
+		while (lo < hi)
+		{
+			mid = (lo + hi) / 2;
+			ti = __dm_table_get_target(map, mid);
+			if (sector < ti->begin)
+				hi = mid;
+			else if (sector >= ti->begin + ti->len)
+				lo = mid + 1;
+			else
+				break;
+		}
+		if (lo >= hi)
+		{
+			prError("sector='%lu': out of range in dm configuration",
+					*p_sector);
+			nvme_ns = ERR_PTR(-ERANGE);
+			goto out;
+		}
+		*p_target_hint = mid;
+	}
+
+	offset = dm_target_offset(ti, sector);
+	if (offset + nr_sects > ti->len)
+	{
+		prError("Bug? page-aligned i/o goes across boundary of dm target"
+				" (sector=%lu, nr_sect=%u)", *p_sector, nr_sects);
+		nvme_ns = ERR_PTR(-ESPIPE);
+		goto out;
+	}
+
+	if (ti->type == ACCESS_ONCE(strom_dm_linear_type))
+	{
+		struct linear_c *lc = ti->private;
+
+		ddev = lc->dev;
+		sector = lc->start + offset;
+	}
+	else if (ti->type == ACCESS_ONCE(strom_dm_striped_type))
+	{
+		struct stripe_c *sc = ti->private;
+		sector_t		chunk = offset;
+		sector_t		chunk_offset;
+		uint32_t		stripe;
+
+		if (sc->chunk_size_shift < 0)
+			chunk_offset = sector_div(chunk, sc->chunk_size);
+		else
+		{
+			chunk_offset = chunk & (sc->chunk_size - 1);
+			chunk >>= sc->chunk_size_shift;
+		}
+
+		if (chunk_offset + nr_sects > sc->chunk_size)
+		{
+			prError("Bug? page-aligned i/o goes across boundary of dm stripe"
+					" (sector=%lu, nr_sect=%u, chunk_sects=%u)",
+					*p_sector, nr_sects, sc->chunk_size);
+			nvme_ns = ERR_PTR(-ESPIPE);
+			goto out;
+		}
+
+		if (sc->stripes_shift < 0)
+			stripe = sector_div(chunk, sc->stripes);
+		else
+		{
+			stripe = chunk & (sc->stripes - 1);
+			chunk >>= sc->stripes_shift;
+		}
+
+		if (sc->chunk_size_shift < 0)
+			chunk *= sc->chunk_size;
+		else
+			chunk <<= sc->chunk_size_shift;
+
+		ddev = sc->stripe[stripe].dev;
+		sector = sc->stripe[stripe].physical_start + chunk + chunk_offset;
+	}
+	else
+	{
+		prError("dm target type '%s' is not supported", ti->type->name);
+		nvme_ns = ERR_PTR(-ENOTSUPP);
+		goto out;
+	}
+
+	/* table might be reloaded to other devices */
+	bdev = ddev->bdev;
+	if (bdev->bd_disk->major != BLOCK_EXT_MAJOR)
+	{
+		prError("dm-device is remapped to '%s', not NVMe-SSD",
+				bdev->bd_disk->disk_name);
+		nvme_ns = ERR_PTR(-ENOTSUPP);
+		goto out;
+	}
+	if (bdev->bd_part)
+		sector += bdev->bd_part->start_sect;
+	nvme_ns = (struct nvme_ns *)bdev->bd_disk->private_data;
+	*p_sector = sector;
+out:
+	__dm_put_live_table(md, srcu_idx);
+	return nvme_ns;
+}
+
+/*
+ * MEMO: nvme_setup_prps() in the vanilla kernel will lead scalability problem
+ * if large concurrent asynchronous DMA is issued. Core of the problem is
+ * dma_pool_alloc() to setup PRPs (Physical Region Page) list for NVMe's READ
+ * command. It tries to walk on a list of pre-allocated pages under spinlock.
+ * Concurrent workload easily grows length of the list up, then duration of
+ * the critical section makes longer.
+ * In case of NVMe-Strom, length of PRPs list is about
+ * (NVMESSD_DMAREQ_MAXSZ / PAGE_SIZE) entries. So, we can pre-allocate
+ * fixed-length PRPs-list buffer, and we can look-up inactive buffer with
+ * one step.
+ * PRPs list longer than a page of the controller is chained; the last entry
+ * of the page points the next page, only if more entries follow. Because
+ * the buffer is physically contiguous, the chain pointer always points the
+ * next entry. See strom_prps_item_append() also.
+ * In case of SGL, a descriptor consumes 2 qwords, and a request can have
+ * one descriptor per PAGE_SIZE at most (+1 for unaligned head), because
+ * destination pages of the sorted runs are not always adjacent. It is
+ * larger than the PRPs list with chain pointers, so determines the size.
+ */
+#define STROM_PRPS_ITEM_NROOMS						\
+	(2 * (NVMESSD_DMAREQ_MAXSZ / PAGE_SIZE + 1))
+struct strom_prps_item
+{
+	struct list_head	chain;
+	dma_addr_t			pitem_dma;	/* physical address of this structure */
+	unsigned int		cpu_id;	/* index to strom_prps_locks/slots */
+	unsigned int		nrooms;	/* size of prps_list[] array */
+	unsigned int		nitems;	/* usage count of prps_list[] array */
+	unsigned int		nsgls;	/* number of SGL descriptors, if SGL */
+	__le64				prps_list[STROM_PRPS_ITEM_NROOMS];
+};
+typedef struct strom_prps_item		strom_prps_item;
+#define STROM_PRPS_ITEMS_NSLOTS		32
+static struct device   *strom_prps_device = NULL;
+static spinlock_t		strom_prps_locks[STROM_PRPS_ITEMS_NSLOTS];
+static struct list_head	strom_prps_slots[STROM_PRPS_ITEMS_NSLOTS];
+
+static __init int
+strom_find_pci_device(struct device *dev, void *data)
+{
+	struct pci_dev	   *pci_device = to_pci_dev(dev);
+    struct pci_driver  *nvme_driver = (struct pci_driver *) data;
+
+	if (nvme_driver)
+	{
+		if (pci_device->driver == nvme_driver)
+			return 1;
+		return 0;
+	}
+	return 1;
+}
+
+static __init int
+strom_init_prps_item_buffer(void)
+{
+    struct device_driver   *dev_driver;
+	int		i;
+
+	/*
+	 * Try to acquire a PCI device which is likely NVMe-SSD.
+	 */
+	dev_driver = driver_find("nvme", &pci_bus_type);
+	if (dev_driver && dev_driver->owner == mod_nvme_alloc_request)
+	{
+		strom_prps_device = bus_find_device(&pci_bus_type, NULL,
+											to_pci_driver(dev_driver),
+											strom_find_pci_device);
+	}
+	if (!strom_prps_device)
+		strom_prps_device = bus_find_device(&pci_bus_type, NULL, NULL,
+											strom_find_pci_device);
+	if (!strom_prps_device)
+	{
+		prError("No PCI device found, thus unable to get entry to alloc/free coherent memory for DMA");
+		return -ENOENT;
+	}
+
+	/* init strom_prps_locks/slots */
+	for (i=0; i < STROM_PRPS_ITEMS_NSLOTS; i++)
+	{
+		spin_lock_init(&strom_prps_locks[i]);
+		INIT_LIST_HEAD(&strom_prps_slots[i]);
+	}
+	return 0;
+}
+
+static void
+strom_exit_prps_item_buffer(void)
+{
+	int		index;
+
+	for (index=0; index < STROM_PRPS_ITEMS_NSLOTS; index++)
+	{
+		spinlock_t		   *lock = &strom_prps_locks[index];
+		struct list_head   *slot = &strom_prps_slots[index];
+		unsigned long		flags;
+		strom_prps_item	   *pitem;
+
+		spin_lock_irqsave(lock, flags);
+		while (!list_empty(slot))
+		{
+			pitem = list_first_entry(slot, strom_prps_item, chain);
+			list_del(&pitem->chain);
+			spin_unlock_irqrestore(lock, flags);
+
+			dma_free_coherent(strom_prps_device,
+							  sizeof(strom_prps_item),
+							  pitem,
+							  pitem->pitem_dma);
+			spin_lock_irqsave(lock, flags);
+		}
+		spin_unlock_irqrestore(lock, flags);
+	}
+	put_device(strom_prps_device);
+}
+
+static strom_prps_item *
+strom_prps_item_alloc(void)
+{
+	int					index = smp_processor_id() % STROM_PRPS_ITEMS_NSLOTS;
+	spinlock_t		   *lock = &strom_prps_locks[index];
+	struct list_head   *slot = &strom_prps_slots[index];
+	unsigned long		flags;
+	dma_addr_t			pitem_dma;
+	strom_prps_item	   *pitem;
+
+	spin_lock_irqsave(lock, flags);
+	if (!list_empty(slot))
+	{
+		pitem = list_first_entry(slot, strom_prps_item, chain);
+		list_del(&pitem->chain);
+		memset(&pitem->chain, 0, sizeof(struct list_head));
+		spin_unlock_irqrestore(lock, flags);
+		pitem->nitems = 0;
+		pitem->nsgls = 0;
+		return pitem;
+	}
+	spin_unlock_irqrestore(lock, flags);
+	/* no available prps_item, so create a new one */
+	pitem = dma_alloc_coherent(strom_prps_device,
+							   sizeof(strom_prps_item),
+							   &pitem_dma,
+							   GFP_KERNEL);
+	if (pitem)
+	{
+		memset(&pitem->chain, 0, sizeof(struct list_head));
+		pitem->pitem_dma = pitem_dma;
+		pitem->cpu_id = smp_processor_id();
+		pitem->nrooms = STROM_PRPS_ITEM_NROOMS;
+		pitem->nitems = 0;
+		pitem->nsgls = 0;
+	}
+	return pitem;
+}
+
+/*
+ * strom_prps_item_append - appends a physical address to the PRPs list.
+ * prps_list[0] is PRP1 of the command, and the following entries are PRP
+ * list. If a new entry goes across the controller's page, the entry on the
+ * last qword of the previous page is moved to the next page, then the last
+ * qword shall be a pointer to the next page of the list, like as
+ * nvme_setup_prps() doing. So, the last qword keeps a data address if no
+ * more entries follow.
+ */
+static inline void
+strom_prps_item_append(strom_prps_item *pitem, dma_addr_t paddr,
+					   u32 nvme_page_size)
+{
+	dma_addr_t	slot_dma;
+
+	if (pitem->nitems > 2)
+	{
+		slot_dma = pitem->pitem_dma +
+			offsetof(strom_prps_item, prps_list[pitem->nitems]);
+		if ((slot_dma & (nvme_page_size - 1)) == 0)
+		{
+			Assert(pitem->nitems < pitem->nrooms);
+			pitem->prps_list[pitem->nitems] =
+				pitem->prps_list[pitem->nitems - 1];
+			pitem->prps_list[pitem->nitems - 1] = slot_dma;
+			pitem->nitems++;
+		}
+	}
+	Assert(pitem->nitems < pitem->nrooms);
+	pitem->prps_list[pitem->nitems++] = paddr;
+}
+
+/*
+ * strom_prps_item_append_sgl - appends a physically contiguous region as
+ * an SGL data block descriptor (16 bytes; address, length and type), or
+ * extends the last descriptor if the region is adjacent to.
+ * The descriptors are put on the prps_list[] array as a segment.
+ */
+#define NVME_SGL_FMT_DATA_DESC		0x00
+#define NVME_SGL_FMT_LAST_SEG_DESC	0x30
+#define NVME_CMD_SGL_METABUF		0x40	/* PSDT=01b in the command flags */
+
+static inline void
+strom_prps_item_append_sgl(strom_prps_item *pitem,
+						   dma_addr_t paddr, size_t length)
+{
+	if (pitem->nsgls > 0)
+	{
+		__le64	   *sgl = &pitem->prps_list[2 * (pitem->nsgls - 1)];
+		size_t		sgl_len = (sgl[1] & 0xffffffffUL);
+
+		if (sgl[0] + sgl_len == paddr &&
+			sgl_len + length <= 0xffffffffUL)
+		{
+			sgl[1] = (sgl_len + length) | ((u64)NVME_SGL_FMT_DATA_DESC << 56);
+			return;
+		}
+	}
+	Assert(2 * pitem->nsgls + 1 < pitem->nrooms);
+	pitem->prps_list[2 * pitem->nsgls]     = paddr;
+	pitem->prps_list[2 * pitem->nsgls + 1] = length | ((u64)NVME_SGL_FMT_DATA_DESC << 56);
+	pitem->nsgls++;
+	pitem->nitems = 2 * pitem->nsgls;
+}
+
+static void
+strom_prps_item_free(strom_prps_item *pitem)
+{
+	int					index = pitem->cpu_id % STROM_PRPS_ITEMS_NSLOTS;
+	spinlock_t		   *lock = &strom_prps_locks[index];
+	struct list_head   *slot = &strom_prps_slots[index];
+	unsigned long		flags;
+
+	Assert(!pitem->chain.next && !pitem->chain.prev);
+	spin_lock_irqsave(lock, flags);
+	list_add(&pitem->chain, slot);
+	spin_unlock_irqrestore(lock, flags);
+}
+
+/*
+ * strom_nvme_max_sectors - max number of sectors per READ command on the
+ * supplied NVMe namespace, according to the MDTS of the controller.
+ */
+static inline unsigned int
+strom_nvme_max_sectors(struct nvme_ns *nvme_ns)
+{
+	unsigned int	max_sectors = (NVMESSD_DMAREQ_MAXSZ >> SECTOR_SHIFT);
+
+	if (nvme_ns->ctrl->max_hw_sectors > 0)
+		max_sectors = Min(max_sectors, nvme_ns->ctrl->max_hw_sectors);
+	max_sectors = Min(max_sectors, queue_max_hw_sectors(nvme_ns->queue));
+	/* must be multiple of PAGE_SIZE */
+	return max_sectors & ~((PAGE_SIZE >> SECTOR_SHIFT) - 1);
+}
+
+/*
+ * strom_nvme_use_sgl - true, if READ command on the supplied NVMe namespace
+ * shall be built with SGL descriptors.
+ */
+static inline bool
+strom_nvme_use_sgl(struct nvme_ns *nvme_ns)
+{
+	strom_nvme_dev *ndev;
+
+	if (!use_sgl)
+		return false;
+	ndev = strom_get_nvme_dev(nvme_ns);
+	return (ndev != NULL && ndev->sgl_support);
+}
+
+/*
+ * DMA transaction for SSD->GPU asynchronous copy
+ */
+struct strom_async_cmd_context {
+	strom_prps_item	   *pitem;
+	strom_dma_task	   *dtask;
+	struct gendisk	   *vol_disk;	/* md/dm volume, if any */
+	strom_nvme_dev	   *ndev;	/* NVMe device state, if any */
+	struct nvme_ns	   *nvme_ns;	/* NVMe namespace to be submitted */
+	struct md_rdev	   *rdev;	/* pinned mirror leg, if md-raid1/10 */
+	unsigned long		failed_legs;/* mirror legs the command failed on */
+	u16					status;	/* status of the failed command */
+	struct work_struct	work;	/* deferred submission on the other node,
+								 * or retry on another mirror leg */
+	int					dest_node;	/* NUMA node of the destination, or -1 */
+	struct nvme_command	cmd;	/* NVMe command */
+	uint64_t			tv1;	/* TSC value when DMA submit */
+	uint32_t			nr_sectors;
+};
+typedef struct strom_async_cmd_context strom_async_cmd_context;
+
+static void __retry_async_read_work(struct work_struct *work);
+
+/*
+ * __callback_async_read_cmd - callback of async READ command
+ */
+static void
+__callback_async_read_cmd(struct request *req, int error)
+{
+	strom_async_cmd_context *async_cxt = req->end_io_data;
+	u32		result = (uintptr_t)req->special;
+	u16		status = req->errors;
+	u64		tv1 = async_cxt->tv1;
+	u64		tv2 = rdtsc();
+
+	prDebug("DMA Req Completed error=%d status=%d result=%u",
+			error, status, result);
+	if (async_cxt->ndev)
+		atomic_dec(&async_cxt->ndev->nr_inflight);
+	/* update statistics */
+	if (stat_info)
+	{
+		atomic64_inc(&stat_nr_ssd2gpu);
+		atomic64_add((u64)(tv2 > tv1 ? tv2 - tv1 : 0), &stat_clk_ssd2gpu);
+		atomic64_dec(&stat_cur_dma_count);
+		if (async_cxt->dest_node >= 0)
+		{
+			if (async_cxt->dest_node == numa_node_id())
+				atomic64_inc(&stat_nr_numa_complete_local);
+			else
+				atomic64_inc(&stat_nr_numa_complete_remote);
+		}
+	}
+	/* update the latency and statistics of the device */
+	if (async_cxt->ndev)
+	{
+		strom_nvme_dev *ndev = async_cxt->ndev;
+
+		if (tv2 > tv1)
+			strom_update_nvme_dev_latency(ndev, tv2 - tv1);
+		if (stat_info)
+		{
+			atomic64_inc(&ndev->nr_cmds);
+			atomic64_add((u64)(tv2 > tv1 ? tv2 - tv1 : 0), &ndev->clk_cmds);
+			if (status)
+				atomic64_inc(&ndev->nr_errors);
+			else
+				atomic64_add((u64)async_cxt->nr_sectors << SECTOR_SHIFT,
+							 &ndev->bytes_read);
+		}
+	}
+	/* retry the failed command on another mirror leg, if any */
+	if (async_cxt->rdev)
+	{
+		if (status)
+		{
+			async_cxt->status = status;
+			INIT_WORK(&async_cxt->work, __retry_async_read_work);
+			queue_work(system_highpri_wq, &async_cxt->work);
+			blk_mq_free_request(req);
+			return;
+		}
+		strom_mirror_unpin_rdev(async_cxt->rdev);
+	}
+	/* update common statistics, if success */
+	if (!status)
+	{
+		struct hd_struct *part = &req->rq_disk->part0;
+		strom_dma_task *dtask = async_cxt->dtask;
+		unsigned long	duration = jiffies - req->start_time;
+		unsigned int	nr_sectors = async_cxt->nr_sectors;
+		int				cpu = part_stat_lock();
+
+		part_stat_add(cpu, part, sectors[0], nr_sectors);
+		part_stat_inc(cpu, part, ios[0]);
+		part_stat_add(cpu, part, ticks[0], duration);
+
+		/* also update statistics of md/dm volume */
+		if (async_cxt->vol_disk)
+		{
+			struct gendisk *vol_disk = async_cxt->vol_disk;
+
+			part_stat_add(cpu, &vol_disk->part0, sectors[0], nr_sectors);
+			part_stat_inc(cpu, &vol_disk->part0, ios[0]);
+			part_stat_add(cpu, &vol_disk->part0, ticks[0], duration);
+		}
+		part_stat_unlock();
+	}
+	strom_prps_item_free(async_cxt->pitem);
+	strom_put_dma_task(async_cxt->dtask, status);
+	strom_objcache_free(&strom_cmd_cxt_cache, async_cxt);
+	blk_mq_free_request(req);
+}
+
+/*
+ * strom_dma_task_dest_node - NUMA node of the destination buffer, or -1 if
+ * unknown (GPU device memory does not belong to any NUMA node of the host)
+ */
+static int
+strom_dma_task_dest_node(strom_dma_task *dtask)
+{
+	strom_dma_buffer   *sd_buf = dtask->sd_buf;
+	size_t				segment_sz;
+
+	if (!sd_buf)
+		return -1;
+	segment_sz = (size_t)sd_buf->segment_sz << PAGE_SHIFT;
+	return page_to_nid(sd_buf->dma_segments[dtask->dest_offset / segment_sz]);
+}
+
+/*
+ * strom_pick_cpu_on_node - pick up an online CPU on the supplied node in
+ * round-robin, or returns nr_cpu_ids if no CPUs are available.
+ */
+static int
+strom_pick_cpu_on_node(int node_id)
+{
+	static atomic_t		rotor = ATOMIC_INIT(0);
+	const struct cpumask *mask = cpumask_of_node(node_id);
+	int			nr_cpus = cpumask_weight(mask);
+	int			cpu;
+	int			k;
+
+	if (nr_cpus == 0)
+		return nr_cpu_ids;
+	k = (unsigned int)atomic_inc_return(&rotor) % nr_cpus;
+	for_each_cpu(cpu, mask)
+	{
+		if (k-- == 0)
+			break;
 	}
-	spin_unlock_irqrestore(lock, flags);
-	/* no available prps_item, so create a new one */
-	pitem = dma_alloc_coherent(strom_prps_device,
-							   sizeof(strom_prps_item),
-							   &pitem_dma,
-							   GFP_KERNEL);
-	if (pitem)
+	if (cpu >= nr_cpu_ids || !cpu_online(cpu))
+		return nr_cpu_ids;
+	return cpu;
+}
+
+/*
+ * __execute_async_read_cmd - allocates a request for the command being
+ * already setup, then throws it to the NVMe driver.
+ */
+static int
+__execute_async_read_cmd(strom_async_cmd_context *async_cmd_cxt)
+{
+	struct nvme_ns *nvme_ns = async_cmd_cxt->nvme_ns;
+	struct request *req;
+
+	req = __nvme_alloc_request(nvme_ns->queue, &async_cmd_cxt->cmd, 0);
+	if (IS_ERR(req))
+		return PTR_ERR(req);
+	async_cmd_cxt->tv1		= rdtsc();
+	req->end_io_data		= async_cmd_cxt;
+	if (async_cmd_cxt->ndev)
 	{
-		memset(&pitem->chain, 0, sizeof(struct list_head));
-		pitem->pitem_dma = pitem_dma;
-		pitem->cpu_id = smp_processor_id();
-		pitem->nrooms = NVMESSD_DMAREQ_MAXSZ / PAGE_SIZE + 1;
-		pitem->nitems = 0;
+		strom_nvme_dev *ndev = async_cmd_cxt->ndev;
+		int		curval = atomic_inc_return(&ndev->nr_inflight);
+
+		if (stat_info)
+		{
+			atomic_max_return(curval, &ndev->max_inflight);
+			strom_update_nvme_dev_volume(ndev, async_cmd_cxt->vol_disk);
+		}
 	}
-	return pitem;
+
+	/* throw asynchronous i/o request */
+	blk_execute_rq_nowait(nvme_ns->queue, nvme_ns->disk, req, 0,
+						  __callback_async_read_cmd);
+	return 0;
 }
 
+/*
+ * __execute_async_read_work - deferred submission on the CPU close to the
+ * destination buffer. Unlike the synchronous path, caller is no longer
+ * available to handle errors, so the DMA task is terminated here.
+ */
 static void
-strom_prps_item_free(strom_prps_item *pitem)
+__execute_async_read_work(struct work_struct *work)
+{
+	strom_async_cmd_context *async_cmd_cxt
+		= container_of(work, strom_async_cmd_context, work);
+	int		retval;
+
+	retval = __execute_async_read_cmd(async_cmd_cxt);
+	if (retval)
+	{
+		prError("failed on deferred submission of READ command (%d)",
+				retval);
+		if (stat_info)
+			atomic64_dec(&stat_cur_dma_count);
+		if (async_cmd_cxt->rdev)
+			strom_mirror_unpin_rdev(async_cmd_cxt->rdev);
+		strom_prps_item_free(async_cmd_cxt->pitem);
+		strom_put_dma_task(async_cmd_cxt->dtask, retval);
+		strom_objcache_free(&strom_cmd_cxt_cache, async_cmd_cxt);
+	}
+}
+
+/*
+ * __retry_async_read_work - resubmits the READ command failed on a mirror
+ * leg to another leg which has the copy. The PRPs list or SGL is already
+ * built for the failed leg, so only the legs that accept the same command
+ * format are eligible. If no leg is available, the DMA task is terminated
+ * with the status of the last failure.
+ */
+static void
+__retry_async_read_work(struct work_struct *work)
+{
+	strom_async_cmd_context *async_cmd_cxt
+		= container_of(work, strom_async_cmd_context, work);
+	struct nvme_rw_command *cmd = &async_cmd_cxt->cmd.rw;
+	struct nvme_ns *nvme_ns = async_cmd_cxt->nvme_ns;
+	struct md_rdev *rdev = async_cmd_cxt->rdev;
+	struct md_rdev *next;
+	unsigned int	nr_sects = async_cmd_cxt->nr_sectors;
+	bool			use_sgl = ((cmd->flags & NVME_CMD_SGL_METABUF) != 0);
+	u32				page_size = nvme_ns->ctrl->page_size;
+	sector_t		sector;
+	u32				lba_sects;
+
+	sector = (le64_to_cpu(cmd->slba) << (nvme_ns->lba_shift - SECTOR_SHIFT));
+	for (;;)
+	{
+		if (rdev->raid_disk >= 0 && rdev->raid_disk < BITS_PER_LONG)
+			__set_bit(rdev->raid_disk, &async_cmd_cxt->failed_legs);
+		next = strom_mirror_retry_leg(rdev, async_cmd_cxt->failed_legs,
+									  &sector, nr_sects);
+		strom_mirror_unpin_rdev(rdev);
+		rdev = next;
+		if (!rdev)
+			break;
+
+		nvme_ns = (struct nvme_ns *)rdev->bdev->bd_disk->private_data;
+		lba_sects = (1U << (nvme_ns->lba_shift - SECTOR_SHIFT));
+		if (strom_nvme_use_sgl(nvme_ns) != use_sgl ||
+			nvme_ns->ctrl->page_size != page_size ||
+			((sector | nr_sects) & (lba_sects - 1)) != 0)
+			continue;
+
+		cmd->nsid	= cpu_to_le32(nvme_ns->ns_id);
+		cmd->slba	= cpu_to_le64(sector >> (nvme_ns->lba_shift -
+											 SECTOR_SHIFT));
+		cmd->length	= cpu_to_le16(nr_sects / lba_sects - 1);
+		async_cmd_cxt->nvme_ns	= nvme_ns;
+		async_cmd_cxt->ndev		= strom_get_nvme_dev(nvme_ns);
+		async_cmd_cxt->rdev		= rdev;
+		if (stat_info)
+			atomic64_inc(&stat_cur_dma_count);
+		if (__execute_async_read_cmd(async_cmd_cxt) == 0)
+		{
+			prNotice("READ command retried on %s (status=%d)",
+					 nvme_ns->disk->disk_name, async_cmd_cxt->status);
+			return;
+		}
+		if (stat_info)
+			atomic64_dec(&stat_cur_dma_count);
+		strom_mirror_unpin_rdev(rdev);
+		break;
+	}
+	prError("READ command failed on all the mirror legs (status=%d)",
+			async_cmd_cxt->status);
+	strom_prps_item_free(async_cmd_cxt->pitem);
+	strom_put_dma_task(async_cmd_cxt->dtask, async_cmd_cxt->status);
+	strom_objcache_free(&strom_cmd_cxt_cache, async_cmd_cxt);
+}
+
+/*
+ * strom_dma_task_mirror - md-raid1/10 volume of the pending request, or NULL
+ */
+static inline struct mddev *
+strom_dma_task_mirror(strom_dma_task *dtask)
+{
+	struct gendisk *vol_disk = dtask->vol_disk;
+	struct mddev   *mddev;
+
+	if (!vol_disk || vol_disk->major != MD_MAJOR)
+		return NULL;
+	mddev = vol_disk->private_data;
+	return (mddev->level != 0 ? mddev : NULL);
+}
+
+/*
+ * __submit_async_read_cmd - it submits READ command of NVMe-SSD, and then
+ * returns immediately. Callback will put the supplied strom_dma_task,
+ * thus, strom_dma_task_wait() allows synchronization of DMA completion.
+ */
+static int
+__submit_async_read_cmd(strom_dma_task *dtask, strom_prps_item *pitem)
+{
+	struct nvme_ns		   *nvme_ns = dtask->nvme_ns;
+	struct nvme_ctrl	   *nvme_ctrl = nvme_ns->ctrl;
+	struct mddev		   *mddev;
+	struct request		   *req;
+	struct nvme_rw_command *cmd;
+	strom_async_cmd_context *async_cmd_cxt;
+	size_t					length;
+	u16						control = 0;
+	u32						dsmgmt = 0;
+	u32						nblocks;
+	u64						slba;
+	dma_addr_t				prp1, prp2;
+	u8						flags = 0;
+	int						npages;
+	int						retval;
+
+	/* setup scatter-gather list */
+	length = (dtask->nr_sectors << SECTOR_SHIFT);
+	nblocks = (dtask->nr_sectors << (SECTOR_SHIFT - nvme_ns->lba_shift)) - 1;
+	if (nblocks > 0xffff)
+		return -EINVAL;
+	slba = dtask->head_sector << (SECTOR_SHIFT - nvme_ns->lba_shift);
+
+	if (pitem->nsgls == 1)
+	{
+		/* a single data block descriptor on the command */
+		prp1 = pitem->prps_list[0];
+		prp2 = pitem->prps_list[1];
+		flags = NVME_CMD_SGL_METABUF;
+	}
+	else if (pitem->nsgls > 1)
+	{
+		/* last segment descriptor that points the data block descriptors */
+		prp1 = pitem->pitem_dma + offsetof(strom_prps_item, prps_list[0]);
+		prp2 = (16UL * pitem->nsgls) | ((u64)NVME_SGL_FMT_LAST_SEG_DESC << 56);
+		flags = NVME_CMD_SGL_METABUF;
+	}
+	else
+	{
+		prp1 = pitem->prps_list[0];
+		npages = ((prp1 & (nvme_ctrl->page_size - 1)) +
+				  length - 1) / nvme_ctrl->page_size;
+		if (npages < 1)
+			prp2 = 0;	/* reserved */
+		else if (npages < 2)
+			prp2 = pitem->prps_list[1];
+		else
+			prp2 = pitem->pitem_dma + offsetof(strom_prps_item, prps_list[1]);
+	}
+
+	/* private datum of async DMA call */
+	async_cmd_cxt = strom_objcache_alloc(&strom_cmd_cxt_cache, GFP_KERNEL);
+	if (!async_cmd_cxt)
+		return -ENOMEM;
+
+	/* setup READ command */
+	cmd = &async_cmd_cxt->cmd.rw;
+	cmd->opcode		= nvme_cmd_read;
+	cmd->flags		= flags;	/* PRPs or SGL */
+	cmd->command_id	= 0;	/* set by nvme driver later */
+	cmd->nsid		= cpu_to_le32(nvme_ns->ns_id);
+	cmd->prp1		= cpu_to_le64(prp1);
+	cmd->prp2		= cpu_to_le64(prp2);
+	cmd->metadata	= 0;	/* XXX integrity check, if needed */
+	cmd->slba		= cpu_to_le64(slba);
+	cmd->length		= cpu_to_le16(nblocks);
+	cmd->control	= cpu_to_le16(control);
+	cmd->dsmgmt		= cpu_to_le32(dsmgmt);
+	/* NOTE: 'reftag', 'apptag' and 'appmask' fields are used only when
+	 * nvme-namespace is formatted to use end-to-end protection information.
+	 * Linux kernel of RHEL7/CentOS7 does not use these fields.
+	 */
+
+	async_cmd_cxt->pitem	= pitem;
+	async_cmd_cxt->dtask	= strom_get_dma_task(dtask);
+	async_cmd_cxt->vol_disk	= dtask->vol_disk;
+	async_cmd_cxt->nr_sectors = dtask->nr_sectors;
+	async_cmd_cxt->nvme_ns	= nvme_ns;
+	async_cmd_cxt->dest_node = strom_dma_task_dest_node(dtask);
+	async_cmd_cxt->ndev		= strom_get_nvme_dev(nvme_ns);
+	if (async_cmd_cxt->ndev)
+		ACCESS_ONCE(dtask->ndev) = async_cmd_cxt->ndev;
+	async_cmd_cxt->rdev		= NULL;
+	async_cmd_cxt->failed_legs = 0;
+	async_cmd_cxt->status	= 0;
+	mddev = strom_dma_task_mirror(dtask);
+	if (mddev)
+	{
+		async_cmd_cxt->rdev = strom_mirror_pin_leg(mddev, nvme_ns,
+												   dtask->head_sector,
+												   dtask->nr_sectors);
+		if (!async_cmd_cxt->rdev)
+		{
+			prError("mirror leg of the READ command is no longer valid");
+			strom_put_dma_task(dtask, 0);
+			strom_objcache_free(&strom_cmd_cxt_cache, async_cmd_cxt);
+			return -EIO;
+		}
+	}
+
+	/*
+	 * If the destination buffer is located on the other NUMA node, we
+	 * move the submission to a CPU of that node. blk-mq maps the request
+	 * to the hardware queue of the submitting CPU, and completes it on
+	 * the same CPU or its sibling, so both of the submission and the
+	 * completion run close to the destination buffer and its waiter.
+	 */
+	if (numa_affinity && async_cmd_cxt->dest_node >= 0 &&
+		async_cmd_cxt->dest_node != numa_node_id())
+	{
+		int		cpu = strom_pick_cpu_on_node(async_cmd_cxt->dest_node);
+
+		if (cpu < nr_cpu_ids)
+		{
+			INIT_WORK(&async_cmd_cxt->work, __execute_async_read_work);
+			queue_work_on(cpu, system_highpri_wq, &async_cmd_cxt->work);
+			if (stat_info)
+				atomic64_inc(&stat_nr_numa_submit_steered);
+			return 0;
+		}
+	}
+	if (stat_info && async_cmd_cxt->dest_node >= 0)
+		atomic64_inc(&stat_nr_numa_submit_local);
+
+	retval = __execute_async_read_cmd(async_cmd_cxt);
+	if (retval)
+	{
+		if (async_cmd_cxt->rdev)
+			strom_mirror_unpin_rdev(async_cmd_cxt->rdev);
+		strom_put_dma_task(dtask, 0);
+		strom_objcache_free(&strom_cmd_cxt_cache, async_cmd_cxt);
+	}
+	return retval;
+}
+
+
+/*
+ * strom_dma_task_probe - check status of a dma_task without blocking
+ *
+ * It returns -EAGAIN if the task is still running, -EIO if the task was
+ * completed with errors (error status is reclaimed here), or 0 if the task
+ * was completed successfully, or not found.
+ */
+static int
+strom_dma_task_probe(strom_proc_state *pstate,
+					 unsigned long dma_task_id,
+					 long *p_dma_task_status)
+{
+	strom_dma_task	   *dtask;
+	unsigned long		flags;
+	int					retval = 0;
+
+	if (dma_task_id == 0 || dma_task_id > INT_MAX)
+		return 0;
+
+	spin_lock_irqsave(&pstate->lock, flags);
+	dtask = idr_find(&pstate->task_idr, dma_task_id);
+	if (!dtask)
+		retval = 0;
+	else if (!dtask->failed)
+		retval = -EAGAIN;
+	else
+	{
+		if (p_dma_task_status)
+			*p_dma_task_status = dtask->dma_status;
+		idr_remove(&pstate->task_idr, dma_task_id);
+		retval = -EIO;
+	}
+	spin_unlock_irqrestore(&pstate->lock, flags);
+
+	if (retval == -EIO)
+		strom_objcache_free(&strom_dma_task_cache, dtask);
+	return retval;
+}
+
+/*
+ * strom_dma_task_cancel - reclaim a dma_task without blocking
+ *
+ * All the commands of the task were already submitted by the time its ID
+ * is returned, so cancel cannot stop them. Running task shall be released
+ * once the commands in-flight get completed, without error status nor
+ * completion ring entry. If the task was already completed with errors,
+ * its error status is reclaimed here.
+ */
+static void
+strom_dma_task_cancel(strom_proc_state *pstate,
+					  unsigned long dma_task_id)
+{
+	strom_dma_task	   *dtask;
+	unsigned long		flags;
+
+	if (dma_task_id == 0 || dma_task_id > INT_MAX)
+		return;
+
+	spin_lock_irqsave(&pstate->lock, flags);
+	dtask = idr_find(&pstate->task_idr, dma_task_id);
+	if (dtask)
+	{
+		if (!dtask->failed)
+			dtask->cancelled = true;
+		else
+		{
+			idr_remove(&pstate->task_idr, dma_task_id);
+			spin_unlock_irqrestore(&pstate->lock, flags);
+			strom_objcache_free(&strom_dma_task_cache, dtask);
+			return;
+		}
+	}
+	spin_unlock_irqrestore(&pstate->lock, flags);
+}
+
+/*
+ * strom_dma_task_spin_budget - TSC clocks to spin prior to sleep
+ *
+ * It is the mean latency of the device where the DMA task submitted the
+ * last command to, but hybrid_polling_max_us at most.
+ */
+static u64
+strom_dma_task_spin_budget(strom_proc_state *pstate,
+						   unsigned long dma_task_id)
+{
+	strom_dma_task	   *dtask;
+	strom_nvme_dev	   *ndev;
+	unsigned long		flags;
+	u64					spin_max;
+	u64					budget = 0;
+
+	if (dma_task_id == 0 || dma_task_id > INT_MAX)
+		return 0;
+
+	spin_max = (u64)Max(hybrid_polling_max_us, 0) * tsc_khz / 1000;
+	spin_lock_irqsave(&pstate->lock, flags);
+	dtask = idr_find(&pstate->task_idr, dma_task_id);
+	if (dtask && !dtask->failed)
+	{
+		ndev = ACCESS_ONCE(dtask->ndev);
+		if (ndev)
+			budget = ACCESS_ONCE(ndev->clk_ewma);
+	}
+	spin_unlock_irqrestore(&pstate->lock, flags);
+
+	return Min(budget, spin_max);
+}
+
+/*
+ * strom_memcpy_wait - synchronization of a dma_task
+ *
+ * If @hybrid_poll, it spins for the mean latency of the device prior to
+ * sleep, because wake up latency of the scheduler is not negligible for
+ * the short DMA.
+ */
+static int
+strom_dma_task_wait(struct file *ioctl_filp,
+					unsigned long dma_task_id,
+					long *p_dma_task_status,
+					int task_state,
+					bool hybrid_poll)
+{
+	strom_proc_state   *pstate = ioctl_filp->private_data;
+	u64					tv1, tv2;
+	u64					spin_budget = 0;
+	unsigned int		nr_completed = 0;
+	int					retval;
+	bool				probed = false;
+	bool				had_sleep = false;
+	DEFINE_DMA_TASK_WAITER(__waiter, dma_task_id);
+
+	if (hybrid_poll || hybrid_polling)
+		spin_budget = strom_dma_task_spin_budget(pstate, dma_task_id);
+	tv1 = rdtsc();
+	for (;;)
+	{
+		bool	spinning = (spin_budget > 0 &&
+							rdtsc() - tv1 < spin_budget &&
+							!need_resched());
+		/*
+		 * NOTE: we have to be on the waitq prior to the checks, not to
+		 * miss the wake up by the task completed during the checks.
+		 * While spinning, the task is probed under the lock only when
+		 * any task got completed since the last probe.
+		 */
+		if (spinning && probed &&
+			ACCESS_ONCE(pstate->nr_completed) == nr_completed)
+			retval = -EAGAIN;
+		else
+		{
+			if (!spinning)
+				prepare_to_wait(&pstate->waitq, &__waiter.wait, task_state);
+			nr_completed = ACCESS_ONCE(pstate->nr_completed);
+			retval = strom_dma_task_probe(pstate, dma_task_id,
+										  p_dma_task_status);
+			probed = true;
+		}
+		if (retval != -EAGAIN)
+			break;
+		if (signal_pending(current))
+		{
+			retval = -EINTR;
+			break;
+		}
+		if (spinning)
+		{
+			cpu_relax();
+			continue;
+		}
+		/* wait for completion of DMA task */
+		schedule();
+		if (stat_info && had_sleep)
+			atomic64_inc(&stat_nr_wrong_wakeup);
+		had_sleep = true;
+	}
+	finish_wait(&pstate->waitq, &__waiter.wait);
+	tv2 = rdtsc();
+	if (stat_info && had_sleep)
+	{
+		atomic64_inc(&stat_nr_wait_dtask);
+		atomic64_add((u64)(tv2 > tv1 ? tv2 - tv1 : 0), &stat_clk_wait_dtask);
+	}
+	return retval;
+}
+
+/*
+ * ioctl(2) handler for STROM_IOCTL__MEMCPY_WAIT
+ */
+static int
+ioctl_memcpy_wait(StromCmd__MemCopyWait __user *uarg,
+				  struct file *ioctl_filp,
+				  size_t usize)
 {
-	int					index = pitem->cpu_id % STROM_PRPS_ITEMS_NSLOTS;
-	spinlock_t		   *lock = &strom_prps_locks[index];
-	struct list_head   *slot = &strom_prps_slots[index];
-	unsigned long		flags;
+	StromCmd__MemCopyWait karg;
+	long		retval;
 
-	Assert(!pitem->chain.next && !pitem->chain.prev);
-	spin_lock_irqsave(lock, flags);
-	list_add(&pitem->chain, slot);
-	spin_unlock_irqrestore(lock, flags);
+	memset(&karg, 0, sizeof(StromCmd__MemCopyWait));
+	if (copy_from_user(&karg, uarg, usize))
+		return -EFAULT;
+
+	karg.status = 0;
+	retval = strom_dma_task_wait(ioctl_filp,
+								 karg.dma_task_id,
+								 &karg.status,
+								 TASK_INTERRUPTIBLE,
+								 (karg.flags & STROM_MEMCPY_WAIT__HYBRID_POLL) != 0);
+	if (copy_to_user(uarg, &karg, usize))
+		return -EFAULT;
+
+	return retval;
 }
 
 /*
- * DMA transaction for SSD->GPU asynchronous copy
+ * ioctl(2) handler for STROM_IOCTL__MEMCPY_CANCEL
  */
-struct strom_async_cmd_context {
-	strom_prps_item	   *pitem;
-	strom_dma_task	   *dtask;
-	struct mddev	   *mddev;	/* md-raid0 device, if any */
-	struct nvme_command	cmd;	/* NVMe command */
-	uint64_t			tv1;	/* TSC value when DMA submit */
-	uint32_t			nr_sectors;
-};
-typedef struct strom_async_cmd_context strom_async_cmd_context;
+static int
+ioctl_memcpy_cancel(StromCmd__MemCopyCancel __user *uarg,
+					struct file *ioctl_filp)
+{
+	StromCmd__MemCopyCancel karg;
+
+	if (copy_from_user(&karg, uarg, sizeof(StromCmd__MemCopyCancel)))
+		return -EFAULT;
+	strom_dma_task_cancel(ioctl_filp->private_data, karg.dma_task_id);
+
+	return 0;
+}
 
 /*
- * __callback_async_read_cmd - callback of async READ command
+ * ioctl(2) handler for STROM_IOCTL__MEMCPY_WAIT_MULTI
+ *
+ * It waits for completion of any (or all) of the supplied DMA tasks, then
+ * reports which ones are completed. Like STROM_IOCTL__MEMCPY_WAIT, ID of
+ * the DMA tasks are valid only on the file descriptor where they were
+ * submitted.
  */
-static void
-__callback_async_read_cmd(struct request *req, int error)
+static int
+ioctl_memcpy_wait_multi(StromCmd__MemCopyWaitMulti __user *uarg,
+						struct file *ioctl_filp)
 {
-	strom_async_cmd_context *async_cxt = req->end_io_data;
-	u32		result = (uintptr_t)req->special;
-	u16		status = req->errors;
-	u64		tv1 = async_cxt->tv1;
-	u64		tv2 = rdtsc();
+	strom_proc_state   *pstate = ioctl_filp->private_data;
+	StromCmd__MemCopyWaitMulti karg;
+	StromWaitEntry	   *tasks;
+	unsigned int		i;
+	bool				hybrid_poll;
+	u64					tv1, tv2;
+	u64					spin_budget = 0;
+	unsigned int		nr_completed = 0;
+	bool				probed = false;
+	bool				had_sleep = false;
+	int					retval = 0;
+	DEFINE_WAIT(__wait);
 
-	prDebug("DMA Req Completed error=%d status=%d result=%u",
-			error, status, result);
-	/* update statistics */
-	if (stat_info)
+	if (copy_from_user(&karg, uarg, sizeof(StromCmd__MemCopyWaitMulti)))
+		return -EFAULT;
+	if (karg.nr_tasks > STROM_MEMCPY_WAIT_MULTI_MAXSZ)
+		return -E2BIG;
+	karg.nr_done = 0;
+	if (karg.nr_tasks == 0)
+		goto out;
+
+	tasks = kmalloc(sizeof(StromWaitEntry) * karg.nr_tasks, GFP_KERNEL);
+	if (!tasks)
+		return -ENOMEM;
+	if (copy_from_user(tasks, karg.tasks,
+					   sizeof(StromWaitEntry) * karg.nr_tasks))
 	{
-		atomic64_inc(&stat_nr_ssd2gpu);
-		atomic64_add((u64)(tv2 > tv1 ? tv2 - tv1 : 0), &stat_clk_ssd2gpu);
-		atomic64_dec(&stat_cur_dma_count);
+		kfree(tasks);
+		return -EFAULT;
 	}
-	/* update common statistics, if success */
-	if (!status)
+	hybrid_poll = ((karg.flags & STROM_MEMCPY_WAIT__HYBRID_POLL) != 0 ||
+				   hybrid_polling);
+	for (i=0; i < karg.nr_tasks; i++)
 	{
-		struct hd_struct *part = &req->rq_disk->part0;
-		strom_dma_task *dtask = async_cxt->dtask;
-		unsigned long	duration = jiffies - req->start_time;
-		unsigned int	nr_sectors = async_cxt->nr_sectors;
-		int				cpu = part_stat_lock();
+		tasks[i].status = 0;
+		tasks[i].done = 0;
+		/* spin up to the longest one, if hybrid polling */
+		if (hybrid_poll)
+		{
+			u64		budget = strom_dma_task_spin_budget(pstate,
+													tasks[i].dma_task_id);
+			spin_budget = Max(spin_budget, budget);
+		}
+	}
 
-		part_stat_add(cpu, part, sectors[0], nr_sectors);
-		part_stat_inc(cpu, part, ios[0]);
-		part_stat_add(cpu, part, ticks[0], duration);
+	tv1 = rdtsc();
+	for (;;)
+	{
+		bool	spinning = (spin_budget > 0 &&
+							rdtsc() - tv1 < spin_budget &&
+							!need_resched());
+		/*
+		 * NOTE: we have to be on the waitq prior to the checks, not to
+		 * miss the wake up by the tasks completed during the checks.
+		 * While spinning, the tasks are probed under the lock only when
+		 * any task got completed since the last probe.
+		 */
+		if (!spinning || !probed ||
+			ACCESS_ONCE(pstate->nr_completed) != nr_completed)
+		{
+			if (!spinning)
+				prepare_to_wait(&pstate->waitq, &__wait,
+								TASK_INTERRUPTIBLE);
+			nr_completed = ACCESS_ONCE(pstate->nr_completed);
+			probed = true;
+			for (i=0; i < karg.nr_tasks; i++)
+			{
+				if (tasks[i].done)
+					continue;
+				if (strom_dma_task_probe(pstate,
+										 tasks[i].dma_task_id,
+										 &tasks[i].status) == -EAGAIN)
+					continue;
+				tasks[i].done = 1;
+				karg.nr_done++;
+			}
+			if (karg.nr_done == karg.nr_tasks ||
+				(!karg.wait_all && karg.nr_done > 0))
+				break;
+		}
+		if (signal_pending(current))
+		{
+			retval = -EINTR;
+			break;
+		}
+		if (spinning)
+		{
+			cpu_relax();
+			continue;
+		}
+		schedule();
+		had_sleep = true;
+	}
+	finish_wait(&pstate->waitq, &__wait);
+	tv2 = rdtsc();
+	if (stat_info && had_sleep)
+	{
+		atomic64_inc(&stat_nr_wait_dtask);
+		atomic64_add((u64)(tv2 > tv1 ? tv2 - tv1 : 0), &stat_clk_wait_dtask);
+	}
+
+	/*
+	 * Error status may be already reclaimed, so we have to write back
+	 * the results even if interrupted.
+	 */
+	if (copy_to_user(karg.tasks, tasks,
+					 sizeof(StromWaitEntry) * karg.nr_tasks))
+		retval = -EFAULT;
+	kfree(tasks);
+out:
+	if (put_user(karg.nr_done, &uarg->nr_done))
+		retval = -EFAULT;
+	return retval;
+}
+
+/*
+ * memcpy_pgcache_to_ubuffer - write back page-cache to user buffer
+ */
+static int
+memcpy_pgcache_to_ubuffer(strom_dma_task *dtask,
+						  struct file *filp,
+						  loff_t fpos,
+						  int nr_pages,
+						  char __user *dest_uaddr)
+{
+	struct page	   *fpage;
+	char		   *kaddr;
+	pgoff_t			fp_index = fpos >> PAGE_CACHE_SHIFT;
+	loff_t			left;
+	int				i, retval = 0;
+
+	for (i=0; i < nr_pages; i++)
+	{
+		fpage = dtask->file_pages[i];
+		/* Synchronous read, if not cached */
+		if (!fpage)
+		{
+			fpage = read_mapping_page(filp->f_mapping, fp_index + i, NULL);
+			if (IS_ERR(fpage))
+			{
+				retval = PTR_ERR(fpage);
+				break;
+			}
+			lock_page(fpage);
+			dtask->file_pages[i] = fpage;
+		}
+		Assert(fpage != NULL);
+
+		/* write-back the pages to userspace, like file_read_actor() */
+		if (unlikely(fault_in_pages_writeable(dest_uaddr, PAGE_CACHE_SIZE)))
+			left = 1;	/* go to slow way */
+		else
+		{
+			kaddr = kmap_atomic(fpage);
+			left = __copy_to_user_inatomic(dest_uaddr, kaddr,
+										   PAGE_CACHE_SIZE);
+			kunmap_atomic(kaddr);
+		}
 
-		/* also update statistics of md-raid0 device */
-		if (dtask->mddev)
+		/* Do it by the slow way, if needed */
+		if (unlikely(left))
 		{
-			struct gendisk *md_disk = dtask->mddev->gendisk;
+			kaddr = kmap(fpage);
+			left = __copy_to_user(dest_uaddr, kaddr, PAGE_CACHE_SIZE);
+			kunmap(fpage);
 
-			part_stat_add(cpu, &md_disk->part0, sectors[0], nr_sectors);
-			part_stat_inc(cpu, &md_disk->part0, ios[0]);
-			part_stat_add(cpu, &md_disk->part0, ticks[0], duration);
+			if (unlikely(left))
+			{
+				retval = -EFAULT;
+				break;
+			}
 		}
-		part_stat_unlock();
+		dest_uaddr += PAGE_CACHE_SIZE;
 	}
-	strom_prps_item_free(async_cxt->pitem);
-	strom_put_dma_task(async_cxt->dtask, status);
-	kfree(async_cxt);
-	blk_mq_free_request(req);
+	return retval;
 }
 
 /*
- * __submit_async_read_cmd - it submits READ command of NVMe-SSD, and then
- * returns immediately. Callback will put the supplied strom_dma_task,
- * thus, strom_dma_task_wait() allows synchronization of DMA completion.
+ * strom_fill_dma_buffer_page - fills up a page of the host DMA buffer, for
+ * holes of the source file. Usually, it is zero-cleared, however, contents
+ * of the page cache are copied if available, because it may be dirty, or
+ * under writeback prior to the block allocation.
  */
 static int
-__submit_async_read_cmd(strom_dma_task *dtask, strom_prps_item *pitem)
+__strom_copy_dma_buffer_page(strom_dma_buffer *sd_buf, loff_t dest_offset,
+							 struct page *fpage)
 {
-	struct nvme_ns		   *nvme_ns = dtask->nvme_ns;
-	struct nvme_ctrl	   *nvme_ctrl = nvme_ns->ctrl;
-	struct request		   *req;
-	struct nvme_rw_command *cmd;
-	strom_async_cmd_context *async_cmd_cxt;
-	size_t					length;
-	u16						control = 0;
-	u32						dsmgmt = 0;
-	u32						nblocks;
-	u64						slba;
-	dma_addr_t				prp1, prp2;
-	int						npages;
-
-	/* setup scatter-gather list */
-	length = (dtask->nr_sectors << SECTOR_SHIFT);
-	nblocks = (dtask->nr_sectors << (SECTOR_SHIFT - nvme_ns->lba_shift)) - 1;
-	if (nblocks > 0xffff)
-		return -EINVAL;
-	slba = dtask->head_sector << (SECTOR_SHIFT - nvme_ns->lba_shift);
+	struct page	   *ppage;
+	char		   *dest;
+	char		   *src;
+	long			j, k;
+
+	/* callers already checked the range, but CPU writes are not fenced */
+	if (WARN_ON(dest_offset < 0 ||
+				(dest_offset & (PAGE_SIZE - 1)) != 0 ||
+				sd_buf->length < PAGE_SIZE ||
+				dest_offset > sd_buf->length - PAGE_SIZE))
+		return -ERANGE;
+	j = (dest_offset >> PAGE_SHIFT) / sd_buf->segment_sz;
+	k = (dest_offset >> PAGE_SHIFT) % sd_buf->segment_sz;
+	ppage = sd_buf->dma_segments[j] + k;
 
-	prp1 = pitem->prps_list[0];
-	npages = ((prp1 & (nvme_ctrl->page_size - 1)) +
-			  length - 1) / nvme_ctrl->page_size;
-	if (npages < 1)
-		prp2 = 0;	/* reserved */
-	else if (npages < 2)
-		prp2 = pitem->prps_list[1];
+	dest = kmap_atomic(ppage);
+	if (fpage && PageUptodate(fpage))
+	{
+		src = kmap_atomic(fpage);
+		memcpy(dest, src, PAGE_SIZE);
+		kunmap_atomic(src);
+	}
 	else
-		prp2 = pitem->pitem_dma + offsetof(strom_prps_item, prps_list[1]);
+		memset(dest, 0, PAGE_SIZE);
+	kunmap_atomic(dest);
 
-	/* private datum of async DMA call */
-	async_cmd_cxt = kzalloc(sizeof(strom_async_cmd_context), GFP_KERNEL);
-	if (!async_cmd_cxt)
-		return -ENOMEM;
+	return 0;
+}
 
-	/* setup READ command */
-	cmd = &async_cmd_cxt->cmd.rw;
-	cmd->opcode		= nvme_cmd_read;
-	cmd->flags		= 0;	/* we use PRPs, rather than SGL */
-	cmd->command_id	= 0;	/* set by nvme driver later */
-	cmd->nsid		= cpu_to_le32(nvme_ns->ns_id);
-	cmd->prp1		= cpu_to_le64(prp1);
-	cmd->prp2		= cpu_to_le64(prp2);
-	cmd->metadata	= 0;	/* XXX integrity check, if needed */
-	cmd->slba		= cpu_to_le64(slba);
-	cmd->length		= cpu_to_le16(nblocks);
-	cmd->control	= cpu_to_le16(control);
-	cmd->dsmgmt		= cpu_to_le32(dsmgmt);
-	/* NOTE: 'reftag', 'apptag' and 'appmask' fields are used only when
-	 * nvme-namespace is formatted to use end-to-end protection information.
-	 * Linux kernel of RHEL7/CentOS7 does not use these fields.
+static int
+strom_fill_dma_buffer_page(strom_dma_buffer *sd_buf, loff_t dest_offset,
+						   struct page *fpage)
+{
+	int		retval;
+
+	retval = __strom_copy_dma_buffer_page(sd_buf, dest_offset, fpage);
+	if (!retval && stat_info)
+		atomic64_inc(&stat_nr_zero_fill);
+	return retval;
+}
+
+/*
+ * strom_copy_cached_page - partial-hybrid mode of SSD2RAM; it copies the
+ * page cache to the host DMA buffer by CPU, if it is up-to-date. Elsewhere,
+ * it returns false and caller has to read the page by DMA.
+ */
+static inline bool
+strom_copy_cached_page(strom_dma_task *dtask, loff_t dest_offset,
+					   struct page *fpage)
+{
+	if (!dtask->copy_cached || !fpage || !PageUptodate(fpage))
+		return false;
+	if (__strom_copy_dma_buffer_page(dtask->sd_buf, dest_offset, fpage))
+		return false;	/* DMA path fails on the range check */
+	if (stat_info)
+		atomic64_inc(&stat_nr_hybrid_copy);
+	return true;
+}
+
+/*
+ * strom_block_cursor - state of the block mapping during a sequential walk
+ * on the file; the current extent is consumed without lookups.
+ */
+typedef struct strom_block_cursor
+{
+	sector_t		iblock;		/* next logical block in the extent */
+	sector_t		blocknr;	/* device block of the @iblock */
+	unsigned int	nr_blocks;	/* remaining blocks in the extent */
+	bool			is_hole;	/* extent is hole or unwritten */
+} strom_block_cursor;
+
+/*
+ * strom_map_file_page - maps a page of the file to the sector on the NVMe
+ * namespace. It returns NULL if the namespace is the one of the DMA task
+ * (raw NVMe-SSD), the namespace of the underlying device (md-raid or
+ * device-mapper), or an error code.
+ * If the whole page is hole or unwritten extent, *p_is_hole is set and
+ * *p_sector is not valid; caller shall fill up the destination by zero.
+ * If the source is raw block device, file offset is the location on the
+ * device as is.
+ */
+static struct nvme_ns *
+strom_map_file_page(strom_dma_task *dtask,
+					struct inode *f_inode,
+					struct block_device *blkdev,
+					loff_t fpos,
+					strom_block_cursor *bcur,
+					sector_t *p_sector,
+					bool *p_is_hole)
+{
+	struct nvme_ns *nvme_ns;
+	sector_t		iblock = (fpos >> f_inode->i_blkbits);
+	sector_t		sector;
+	unsigned int	page_nr_blocks = (PAGE_CACHE_SIZE >> f_inode->i_blkbits);
+	int				retval;
+
+	if (S_ISBLK(f_inode->i_mode))
+	{
+		sector = (fpos >> SECTOR_SHIFT);
+		*p_is_hole = false;
+		goto out_remap;
+	}
+
+	/* lookup the source block number, unless the current extent still
+	 * covers this page */
+	if (bcur->nr_blocks == 0 || bcur->iblock != iblock)
+	{
+		retval = strom_lookup_extent(&dtask->ecache,
+									 f_inode, iblock,
+									 &bcur->blocknr,
+									 &bcur->nr_blocks,
+									 &bcur->is_hole);
+		if (retval)
+		{
+			prError("strom_lookup_extent: %d", retval);
+			return ERR_PTR(retval);
+		}
+		bcur->iblock = iblock;
+	}
+
+	if (bcur->is_hole)
+	{
+		/* rest of the blocks in the page must be hole also */
+		while (bcur->nr_blocks < page_nr_blocks)
+		{
+			sector_t		blocknr;
+			unsigned int	nr_blocks;
+			bool			is_hole;
+
+			retval = strom_lookup_extent(&dtask->ecache,
+										 f_inode,
+										 iblock + bcur->nr_blocks,
+										 &blocknr, &nr_blocks, &is_hole);
+			if (retval)
+				return ERR_PTR(retval);
+			if (!is_hole)
+			{
+				prError("page at %lu is partially mapped",
+						(unsigned long)(fpos >> PAGE_CACHE_SHIFT));
+				return ERR_PTR(-ENOTSUPP);
+			}
+			bcur->nr_blocks += nr_blocks;
+		}
+		bcur->iblock    += page_nr_blocks;
+		bcur->nr_blocks -= page_nr_blocks;
+		*p_sector = 0;
+		*p_is_hole = true;
+		return NULL;
+	}
+	*p_is_hole = false;
+
+	/* adjust location according to sector-size and table partition */
+	sector = bcur->blocknr << (f_inode->i_blkbits - SECTOR_SHIFT);
+	if (bcur->nr_blocks > page_nr_blocks)
+	{
+		bcur->iblock    += page_nr_blocks;
+		bcur->blocknr   += page_nr_blocks;
+		bcur->nr_blocks -= page_nr_blocks;
+	}
+	else
+		bcur->nr_blocks = 0;
+out_remap:
+	if (blkdev->bd_part)
+		sector += blkdev->bd_part->start_sect;
+
+	/*
+	 * NOTE: If we have MD RAID configuration, block number on the MD
+	 * device shall be remapped to the block number on the raw NVMe-SSD
+	 * here.
+	 * The logic to map block number of RAID-0 is equivalent to find_zone()
+	 * and map_sector() at drivers/md/raid0.c. RAID-1/10 picks up one of
+	 * the mirror legs by strom_mirror_map_sector(). Device-mapper volume is
+	 * remapped by strom_dm_map_sector().
 	 */
+	if (dtask->mddev)
+	{
+		WARN_ON(dtask->mddev != blkdev->bd_disk->private_data);
 
-	/* allocation of the request */
-	req = __nvme_alloc_request(nvme_ns->queue, &async_cmd_cxt->cmd, 0);
-	if (IS_ERR(req))
+		if (dtask->mddev->level == 0)
+			nvme_ns = strom_raid0_map_sector(dtask->raid0_geom,
+											 &sector,
+											 PAGE_CACHE_SIZE >> SECTOR_SHIFT);
+		else
+			nvme_ns = strom_mirror_map_sector(dtask,
+											  dtask->mddev,
+											  &sector,
+											  PAGE_CACHE_SIZE >> SECTOR_SHIFT);
+		if (IS_ERR(nvme_ns))
+			return nvme_ns;
+	}
+	else if (dtask->dm_md)
 	{
-		kfree(async_cmd_cxt);
-		return PTR_ERR(req);
+		WARN_ON(dtask->dm_md != blkdev->bd_disk->private_data);
+
+		nvme_ns = strom_dm_map_sector(dtask->dm_md,
+									  &dtask->dm_target_hint,
+									  &sector,
+									  PAGE_CACHE_SIZE >> SECTOR_SHIFT);
+		if (IS_ERR(nvme_ns))
+			return nvme_ns;
 	}
-	async_cmd_cxt->pitem	= pitem;
-	async_cmd_cxt->dtask	= strom_get_dma_task(dtask);
-	async_cmd_cxt->mddev	= NULL;
-	async_cmd_cxt->tv1		= rdtsc();
-	async_cmd_cxt->nr_sectors = dtask->nr_sectors;
-	req->end_io_data		= async_cmd_cxt;
-
-	/* throw asynchronous i/o request */
-	blk_execute_rq_nowait(nvme_ns->queue, nvme_ns->disk, req, 0,
-						  __callback_async_read_cmd);
-	return 0;
+	else
+	{
+		/* case of raw NVMe-SSD device */
+		nvme_ns = NULL;
+	}
+	*p_sector = sector;
+	return nvme_ns;
 }
 
-
 /*
- * strom_memcpy_wait - synchronization of a dma_task
+ * strom_setup_stripe_slots - setup the slots of pending requests for each
+ * member of md-raid0. It is available only for the host DMA buffer, because
+ * blocks of a member are not contiguous on the destination; they have to be
+ * scattered by the PRPs list or SGL.
  */
 static int
-strom_dma_task_wait(unsigned long dma_task_id,
-					long *p_dma_task_status,
-					int task_state)
+strom_setup_stripe_slots(strom_dma_task *dtask)
 {
-	int					hindex = strom_dma_task_index(dma_task_id);
-	spinlock_t		   *lock = &strom_dma_task_locks[hindex];
-	wait_queue_head_t  *waitq = &strom_dma_task_waitq[hindex];
-	unsigned long		flags = 0;
-	strom_dma_task	   *dtask;
-	struct list_head   *slot;
-	u64					tv1, tv2;
-	int					retval = 0;
-	bool				had_sleep = false;
-	DEFINE_WAIT(__wait);
+	strom_raid0_geom   *geom = dtask->raid0_geom;
 
-	tv1 = rdtsc();
-	for (;;)
-	{
-		bool	has_spinlock = false;
-		bool	task_is_running = false;
+	Assert(dtask->stripe_slots == NULL);
+	if (!geom || !dtask->sd_buf ||
+		geom->nr_members < 2 ||
+		geom->nr_members > STROM_STRIPE_MAX_SLOTS)
+		return 0;
+	dtask->stripe_slots = kcalloc(geom->nr_members,
+								  sizeof(strom_stripe_slot), GFP_KERNEL);
+	if (!dtask->stripe_slots)
+		return -ENOMEM;
+	dtask->nr_stripe_slots = geom->nr_members;
+	return 0;
+}
 
-		rcu_read_lock();
-	retry:
-		/* check error status first */
-		slot = &failed_dma_task_slots[hindex];
-		list_for_each_entry_rcu(dtask, slot, chain)
-		{
-			if (dtask->dma_task_id == dma_task_id)
-			{
-				if (!has_spinlock)
-				{
-					rcu_read_unlock();
-					has_spinlock = true;
-					spin_lock_irqsave(lock, flags);
-					goto retry;
-				}
-				if (p_dma_task_status)
-					*p_dma_task_status = dtask->dma_status;
-				list_del(&dtask->chain);
-				spin_unlock_irqrestore(lock, flags);
-				kfree(dtask);
-				retval = -EIO;
+/*
+ * strom_release_stripe_slots
+ */
+static void
+strom_release_stripe_slots(strom_dma_task *dtask)
+{
+	int		i;
 
-				goto out;
-			}
-		}
+	if (!dtask->stripe_slots)
+		return;
+	for (i=0; i < dtask->nr_stripe_slots; i++)
+		kfree(dtask->stripe_slots[i].dest_runs);
+	kfree(dtask->stripe_slots);
+	dtask->stripe_slots = NULL;
+	dtask->nr_stripe_slots = 0;
+}
 
-		/* check whether it is a running task or not */
-		slot = &strom_dma_task_slots[hindex];
-		list_for_each_entry_rcu(dtask, slot, chain)
-		{
-			if (dtask->dma_task_id == dma_task_id)
-			{
-				task_is_running = true;
-				break;
-			}
-		}
-		if (has_spinlock)
-			spin_unlock_irqrestore(lock, flags);
-		else
-			rcu_read_unlock();
+/*
+ * strom_lookup_stripe_slot - lookup the slot of the member, or assign an
+ * empty one
+ */
+static strom_stripe_slot *
+strom_lookup_stripe_slot(strom_dma_task *dtask, struct nvme_ns *nvme_ns)
+{
+	strom_stripe_slot  *slot;
+	int		i;
 
-		if (!task_is_running)
-			break;
-		if (signal_pending(current))
+	for (i=0; i < dtask->nr_stripe_slots; i++)
+	{
+		slot = &dtask->stripe_slots[i];
+		if (slot->nvme_ns == nvme_ns)
+			return slot;
+		if (!slot->nvme_ns)
 		{
-			retval = -EINTR;
-			break;
+			slot->dest_runs = kmalloc(sizeof(strom_dest_run) *
+									  (NVMESSD_DMAREQ_MAXSZ >> PAGE_SHIFT),
+									  GFP_KERNEL);
+			if (!slot->dest_runs)
+				return ERR_PTR(-ENOMEM);
+			slot->nvme_ns = nvme_ns;
+			slot->scatter = (strom_nvme_use_sgl(nvme_ns) ||
+							 nvme_ns->ctrl->page_size == PAGE_SIZE);
+			return slot;
 		}
-		/* wait for completion of DMA task */
-		prepare_to_wait(waitq, &__wait, task_state);
-		schedule();
-		if (stat_info && had_sleep)
-			atomic64_inc(&stat_nr_wrong_wakeup);
-		had_sleep = true;
 	}
-out:
-	finish_wait(waitq, &__wait);
-	tv2 = rdtsc();
-	if (stat_info && had_sleep)
+	prError("Bug? more members than md-raid0 configuration");
+	return ERR_PTR(-ENOSPC);
+}
+
+/*
+ * strom_submit_stripe_slot - submit the pending request of the slot
+ */
+static int
+strom_submit_stripe_slot(strom_dma_task *dtask,
+						 strom_stripe_slot *slot,
+						 int (*submit_async_memcpy)(strom_dma_task *),
+						 unsigned int *p_nr_dma_submit,
+						 unsigned int *p_nr_dma_blocks)
+{
+	int		retval;
+
+	dtask->nvme_ns		= slot->nvme_ns;
+	dtask->dest_offset	= slot->dest_runs[0].dest_offset;
+	dtask->head_sector	= slot->head_sector;
+	dtask->nr_sectors	= slot->nr_sectors;
+	if (slot->scatter)
 	{
-		atomic64_inc(&stat_nr_wait_dtask);
-		atomic64_add((u64)(tv2 > tv1 ? tv2 - tv1 : 0), &stat_clk_wait_dtask);
+		dtask->dest_runs	= slot->dest_runs;
+		dtask->nr_dest_runs	= slot->nr_dest_runs;
 	}
+	(*p_nr_dma_submit)++;
+	(*p_nr_dma_blocks) += slot->nr_sectors;
+	retval = submit_async_memcpy(dtask);
+	if (retval)
+		prError("submit_async_memcpy: %d", retval);
+	dtask->dest_runs	= NULL;
+	dtask->nr_dest_runs	= 0;
+	dtask->nr_sectors	= 0;
+	slot->nr_sectors	= 0;
+	slot->nr_dest_runs	= 0;
+
 	return retval;
 }
 
 /*
- * ioctl(2) handler for STROM_IOCTL__MEMCPY_WAIT
+ * strom_flush_stripe_slots - submit the pending requests of all the members.
+ * A member with less commands in-flight goes first, not to make the busy
+ * member the straggler.
  */
 static int
-ioctl_memcpy_wait(StromCmd__MemCopyWait __user *uarg,
-				  struct file *ioctl_filp)
+strom_flush_stripe_slots(strom_dma_task *dtask,
+						 int (*submit_async_memcpy)(strom_dma_task *),
+						 unsigned int *p_nr_dma_submit,
+						 unsigned int *p_nr_dma_blocks)
 {
-	StromCmd__MemCopyWait karg;
-	long		retval;
-
-	if (copy_from_user(&karg, uarg, sizeof(StromCmd__MemCopyWait)))
-		return -EFAULT;
+	strom_stripe_slot  *slot;
+	strom_stripe_slot  *best;
+	strom_nvme_dev	   *ndev;
+	int		best_load;
+	int		load;
+	int		i, retval;
 
-	karg.status = 0;
-	retval = strom_dma_task_wait(karg.dma_task_id,
-								 &karg.status,
-								 TASK_INTERRUPTIBLE);
-	if (copy_to_user(uarg, &karg, sizeof(StromCmd__MemCopyWait)))
-		return -EFAULT;
-
-	return retval;
+	for (;;)
+	{
+		best = NULL;
+		best_load = INT_MAX;
+		rcu_read_lock();
+		for (i=0; i < dtask->nr_stripe_slots; i++)
+		{
+			slot = &dtask->stripe_slots[i];
+			if (slot->nr_sectors == 0)
+				continue;
+			ndev = __strom_lookup_nvme_dev(slot->nvme_ns);
+			load = (ndev ? atomic_read(&ndev->nr_inflight) : 0);
+			if (!best || load < best_load)
+			{
+				best = slot;
+				best_load = load;
+			}
+		}
+		rcu_read_unlock();
+		if (!best)
+			break;
+		retval = strom_submit_stripe_slot(dtask, best,
+										  submit_async_memcpy,
+										  p_nr_dma_submit,
+										  p_nr_dma_blocks);
+		if (retval)
+			return retval;
+	}
+	return 0;
 }
 
 /*
- * memcpy_pgcache_to_ubuffer - write back page-cache to user buffer
+ * memcpy_from_raid0_striped - a variation of memcpy_from_nvme_ssd() for
+ * md-raid0 with the slots of pending requests. Pages on a member are merged
+ * to the pending request of the member, even if pages of other members are
+ * interleaved, thus, a large logical read is split into one READ command
+ * per member (up to the max transfer size), to be submitted in parallel.
  */
 static int
-memcpy_pgcache_to_ubuffer(strom_dma_task *dtask,
-						  struct file *filp,
+memcpy_from_raid0_striped(strom_dma_task *dtask,
+						  struct inode *f_inode,
+						  struct block_device *blkdev,
 						  loff_t fpos,
 						  int nr_pages,
-						  char __user *dest_uaddr)
+						  loff_t dest_offset,
+						  int (*submit_async_memcpy)(strom_dma_task *),
+						  unsigned int *p_nr_dma_submit,
+						  unsigned int *p_nr_dma_blocks)
 {
-	struct page	   *fpage;
-	char		   *kaddr;
-	pgoff_t			fp_index = fpos >> PAGE_CACHE_SHIFT;
-	loff_t			left;
+	strom_stripe_slot *slot;
+	struct nvme_ns *nvme_ns;
+	strom_block_cursor bcur;
+	sector_t		sector;
+	bool			is_hole;
+	bool			mergeable;
+	unsigned int	nr_sects = (PAGE_CACHE_SIZE >> SECTOR_SHIFT);
+	loff_t			curr_offset = dest_offset;
+	loff_t			dest_segment_sz;
 	int				i, retval = 0;
 
-	for (i=0; i < nr_pages; i++)
+	dest_segment_sz = (loff_t)dtask->sd_buf->segment_sz * (loff_t)PAGE_SIZE;
+	memset(&bcur, 0, sizeof(strom_block_cursor));
+	for (i=0; i < nr_pages; i++, fpos += PAGE_CACHE_SIZE)
 	{
-		fpage = dtask->file_pages[i];
-		/* Synchronous read, if not cached */
-		if (!fpage)
+		if (strom_copy_cached_page(dtask, curr_offset, dtask->file_pages[i]))
 		{
-			fpage = read_mapping_page(filp->f_mapping, fp_index + i, NULL);
-			if (IS_ERR(fpage))
-			{
-				retval = PTR_ERR(fpage);
+			curr_offset += PAGE_CACHE_SIZE;
+			continue;
+		}
+		nvme_ns = strom_map_file_page(dtask, f_inode, blkdev, fpos,
+									  &bcur, &sector, &is_hole);
+		if (IS_ERR(nvme_ns))
+		{
+			retval = PTR_ERR(nvme_ns);
+			break;
+		}
+		if (is_hole)
+		{
+			retval = strom_fill_dma_buffer_page(dtask->sd_buf, curr_offset,
+												dtask->file_pages[i]);
+			if (retval)
 				break;
-			}
-			lock_page(fpage);
-			dtask->file_pages[i] = fpage;
+			curr_offset += PAGE_CACHE_SIZE;
+			continue;
 		}
-		Assert(fpage != NULL);
-
-		/* write-back the pages to userspace, like file_read_actor() */
-		if (unlikely(fault_in_pages_writeable(dest_uaddr, PAGE_CACHE_SIZE)))
-			left = 1;	/* go to slow way */
-		else
+		Assert(nvme_ns != NULL);
+		slot = strom_lookup_stripe_slot(dtask, nvme_ns);
+		if (IS_ERR(slot))
 		{
-			kaddr = kmap_atomic(fpage);
-			left = __copy_to_user_inatomic(dest_uaddr, kaddr,
-										   PAGE_CACHE_SIZE);
-			kunmap_atomic(kaddr);
+			retval = PTR_ERR(slot);
+			break;
 		}
 
-		/* Do it by the slow way, if needed */
-		if (unlikely(left))
+		/*
+		 * The page is mergeable to the pending request of the member if
+		 * it is adjacent on the device. Destination may be discontiguous,
+		 * as long as the blocks can be scattered by page; elsewhere, it
+		 * must be contiguous within a segment of the DMA buffer.
+		 */
+		mergeable = false;
+		if (slot->nr_sectors > 0 &&
+			slot->head_sector + slot->nr_sectors == sector &&
+			slot->nr_sectors + nr_sects <= strom_nvme_max_sectors(nvme_ns))
 		{
-			kaddr = kmap(fpage);
-			left = __copy_to_user(dest_uaddr, kaddr, PAGE_CACHE_SIZE);
-			kunmap(fpage);
+			strom_dest_run *drun = &slot->dest_runs[slot->nr_dest_runs-1];
 
-			if (unlikely(left))
+			if (drun->dest_offset +
+				((loff_t)drun->nr_pages << PAGE_SHIFT) == curr_offset &&
+				(slot->scatter ||
+				 (curr_offset / dest_segment_sz) ==
+				 (curr_offset + PAGE_CACHE_SIZE - 1) / dest_segment_sz))
 			{
-				retval = -EFAULT;
-				break;
+				drun->nr_pages++;
+				mergeable = true;
+			}
+			else if (slot->scatter)
+			{
+				drun = &slot->dest_runs[slot->nr_dest_runs++];
+				drun->dest_offset = curr_offset;
+				drun->nr_pages = 1;
+				mergeable = true;
 			}
 		}
-		dest_uaddr += PAGE_CACHE_SIZE;
+
+		if (mergeable)
+			slot->nr_sectors += nr_sects;
+		else
+		{
+			if (slot->nr_sectors > 0)
+			{
+				retval = strom_submit_stripe_slot(dtask, slot,
+												  submit_async_memcpy,
+												  p_nr_dma_submit,
+												  p_nr_dma_blocks);
+				if (retval)
+					break;
+			}
+			slot->head_sector = sector;
+			slot->nr_sectors = nr_sects;
+			slot->dest_runs[0].dest_offset = curr_offset;
+			slot->dest_runs[0].nr_pages = 1;
+			slot->nr_dest_runs = 1;
+		}
+		curr_offset += PAGE_CACHE_SIZE;
 	}
 	return retval;
 }
 
+#define STROM_NO_SECTOR		((sector_t)~0UL)	/* page needs no device I/O */
+
 /*
  * Submit READ command to NVMe SSD device
+ *
+ * All the pages of the chunk are mapped prior to submission. If GPU device
+ * memory is the destination, a chunk with holes returns -ENODATA without
+ * any commands submitted, so caller can write back the chunk instead.
  */
 static int
 memcpy_from_nvme_ssd(strom_dma_task *dtask,
@@ -1311,65 +4083,68 @@ memcpy_from_nvme_ssd(strom_dma_task *dtask,
 					 unsigned int *p_nr_dma_submit,
 					 unsigned int *p_nr_dma_blocks)
 {
-	struct buffer_head	bh;
 	struct nvme_ns *nvme_ns;
+	strom_block_cursor bcur;
 	sector_t		sector;
-	unsigned int	nr_sects;
-	unsigned int	max_nr_sects = (NVMESSD_DMAREQ_MAXSZ >> SECTOR_SHIFT);
+	bool			is_hole;
+	unsigned int	nr_sects = (PAGE_CACHE_SIZE >> SECTOR_SHIFT);
 	loff_t			curr_offset = dest_offset;
 	int				i, retval = 0;
 
-	for (i=0; i < nr_pages; i++, fpos += PAGE_CACHE_SIZE)
+	if (dtask->stripe_slots)
+		return memcpy_from_raid0_striped(dtask,
+										 f_inode,
+										 blkdev,
+										 fpos,
+										 nr_pages,
+										 dest_offset,
+										 submit_async_memcpy,
+										 p_nr_dma_submit,
+										 p_nr_dma_blocks);
+
+	memset(&bcur, 0, sizeof(strom_block_cursor));
+	for (i=0; i < nr_pages; i++, fpos += PAGE_CACHE_SIZE,
+			 curr_offset += PAGE_CACHE_SIZE)
 	{
-		/* lookup the source block number */
-		memset(&bh, 0, sizeof(bh));
-		bh.b_size = (1UL << f_inode->i_blkbits);
-
-		retval = strom_get_block(f_inode,
-								 fpos >> f_inode->i_blkbits,
-								 &bh, 0);
-		if (retval)
+		dtask->file_sectors[i] = STROM_NO_SECTOR;
+		if (strom_copy_cached_page(dtask, curr_offset, dtask->file_pages[i]))
+			continue;
+		nvme_ns = strom_map_file_page(dtask, f_inode, blkdev, fpos,
+									  &bcur, &sector, &is_hole);
+		if (IS_ERR(nvme_ns))
+			return PTR_ERR(nvme_ns);
+		if (is_hole)
 		{
-			prError("strom_get_block: %d", retval);
-			break;
+			/*
+			 * No device I/O for holes; host buffer is filled up by CPU.
+			 * GPU device memory is not, so caller shall write back the
+			 * chunk from the page cache.
+			 */
+			if (!dtask->sd_buf)
+				return -ENODATA;
+			retval = strom_fill_dma_buffer_page(dtask->sd_buf, curr_offset,
+												dtask->file_pages[i]);
+			if (retval)
+				return retval;
+			continue;
 		}
+		dtask->file_nvme_ns[i] = nvme_ns;
+		dtask->file_sectors[i] = sector;
+	}
 
-		/* adjust location according to sector-size and table partition */
-		sector = bh.b_blocknr << (f_inode->i_blkbits - SECTOR_SHIFT);
-		if (blkdev->bd_part)
-			sector += blkdev->bd_part->start_sect;
-		nr_sects = PAGE_CACHE_SIZE >> SECTOR_SHIFT;
-
-		/*
-		 * NOTE: If we have MD RAID-0 configuration, block number on the MD
-		 * device shall be remapped to the block number on the raw NVMe-SSD
-		 * here.
-		 * The logic to map block number is equivalent to find_zone() and
-		 * map_sector() at drivers/md/raid0.c.
-		 */
-		if (dtask->mddev)
-		{
-			WARN_ON(dtask->mddev != blkdev->bd_disk->private_data);
-
-			nvme_ns = strom_raid0_map_sector(dtask->mddev,
-											 &sector,
-											 nr_sects);
-			if (IS_ERR(nvme_ns))
-			{
-				retval = PTR_ERR(nvme_ns);
-				break;
-			}
-		}
-		else
-		{
-			/* case of raw NVMe-SSD device */
-			nvme_ns = NULL;
-		}
+	curr_offset = dest_offset;
+	for (i=0; i < nr_pages; i++, curr_offset += PAGE_CACHE_SIZE)
+	{
+		nvme_ns = dtask->file_nvme_ns[i];
+		sector = dtask->file_sectors[i];
+		if (sector == STROM_NO_SECTOR)
+			continue;
 
 		/* merge with pending request if possible */
-		if ((!nvme_ns || dtask->nvme_ns == nvme_ns) &&
-			dtask->nr_sectors > 0 &&
-			dtask->nr_sectors + nr_sects <= max_nr_sects &&
+		if (dtask->nr_sectors > 0 &&
+			(!nvme_ns || dtask->nvme_ns == nvme_ns) &&
+			dtask->nr_sectors + nr_sects <=
+			strom_nvme_max_sectors(dtask->nvme_ns) &&
 			dtask->head_sector + dtask->nr_sectors == sector &&
 			dtask->dest_offset +
 			SECTOR_SIZE * dtask->nr_sectors == curr_offset &&
@@ -1399,7 +4174,6 @@ memcpy_from_nvme_ssd(strom_dma_task *dtask,
 			dtask->head_sector = sector;
 			dtask->nr_sectors  = nr_sects;
 		}
-		curr_offset += PAGE_CACHE_SIZE;
 	}
 	return retval;
 }
@@ -1430,7 +4204,8 @@ submit_ssd2gpu_memcpy(strom_dma_task *dtask)
 	WARN_ON(nvme_page_size < PAGE_SIZE);
 
 	total_nbytes = SECTOR_SIZE * dtask->nr_sectors;
-	if (!total_nbytes || total_nbytes > NVMESSD_DMAREQ_MAXSZ)
+	if (!total_nbytes ||
+		total_nbytes > SECTOR_SIZE * strom_nvme_max_sectors(nvme_ns))
 		return -EINVAL;
 	if (dtask->dest_offset < mgmem->map_offset ||
 		dtask->dest_offset + total_nbytes > (mgmem->map_offset +
@@ -1445,17 +4220,35 @@ submit_ssd2gpu_memcpy(strom_dma_task *dtask)
 	i =  (dtask->dest_offset >> mgmem->gpu_page_shift);
 	curr_paddr = (page_table->pages[i]->physical_address +
 				  (dtask->dest_offset & (mgmem->gpu_page_sz - 1)));
-	length = nvme_page_size - (curr_paddr & (nvme_page_size - 1));
-	for (i=0; total_nbytes > 0; i++)
+	if (strom_nvme_use_sgl(nvme_ns))
+	{
+		/* one SGL descriptor per physically contiguous GPU pages */
+		length = mgmem->gpu_page_sz - (curr_paddr & (mgmem->gpu_page_sz - 1));
+		while (total_nbytes > 0)
+		{
+			length = Min(total_nbytes, length);
+			strom_prps_item_append_sgl(pitem, curr_paddr, length);
+			total_nbytes -= length;
+			if (total_nbytes > 0)
+			{
+				Assert(i + 1 < page_table->entries);
+				curr_paddr = page_table->pages[++i]->physical_address;
+				length = mgmem->gpu_page_sz;
+			}
+		}
+	}
+	else
 	{
-		Assert(i < pitem->nrooms);
-		pitem->prps_list[i] = curr_paddr;
-		curr_paddr += length;
-		total_nbytes -= length;
+		length = nvme_page_size - (curr_paddr & (nvme_page_size - 1));
+		while (total_nbytes > 0)
+		{
+			strom_prps_item_append(pitem, curr_paddr, nvme_page_size);
+			curr_paddr += length;
+			total_nbytes -= length;
 
-		length = Min(total_nbytes, nvme_page_size);
+			length = Min(total_nbytes, nvme_page_size);
+		}
 	}
-	pitem->nitems = i;
 	if (stat_info)
 	{
 		tv2 = rdtsc();
@@ -1481,6 +4274,37 @@ submit_ssd2gpu_memcpy(strom_dma_task *dtask)
 	return retval;
 }
 
+/*
+ * strom_check_dest_offsets - checks the destination offsets of chunks given
+ * by the caller, and returns the length of the destination to be covered.
+ * Every chunk must fit in the @dest_limit bytes from the head of the
+ * destination. Offsets are user supplied, so they are compared with the
+ * room for the chunk, not added to the chunk size that may wrap around.
+ */
+static int
+strom_check_dest_offsets(uint64_t *dest_offsets,
+						 unsigned int nr_chunks,
+						 unsigned int chunk_sz,
+						 size_t dest_limit,
+						 size_t *p_dest_length)
+{
+	size_t		dest_length = 0;
+	long		i;
+
+	if (chunk_sz > dest_limit)
+		return -ERANGE;
+	for (i=0; i < nr_chunks; i++)
+	{
+		if ((dest_offsets[i] & (PAGE_CACHE_SIZE - 1)) != 0)
+			return -EINVAL;
+		if (dest_offsets[i] > dest_limit - chunk_sz)
+			return -ERANGE;
+		dest_length = Max(dest_length, dest_offsets[i] + chunk_sz);
+	}
+	*p_dest_length = dest_length;
+	return 0;
+}
+
 /*
  * main logic of STROM_IOCTL__MEMCPY_SSD2GPU
  */
@@ -1488,14 +4312,16 @@ static int
 do_memcpy_ssd2gpu(StromCmd__MemCopySsdToGpu *karg,
 				  strom_dma_task *dtask,
 				  uint32_t *chunk_ids_in,
-				  uint32_t *chunk_ids_out)
+				  uint32_t *chunk_ids_out,
+				  uint64_t *dest_offsets_in,
+				  uint64_t *dest_offsets_out)
 {
 	mapped_gpu_memory  *mgmem = dtask->mgmem;
 	struct file		   *filp = dtask->filp;
 	struct inode	   *f_inode = filp->f_inode;
-	struct super_block *i_sb = f_inode->i_sb;
 	char __user		   *dest_uaddr;
 	size_t				dest_offset;
+	size_t				dest_length;
 	unsigned int		nr_pages = (karg->chunk_sz >> PAGE_CACHE_SHIFT);
 	int					threshold = nr_pages / 2;
 	size_t				i_size;
@@ -1505,15 +4331,27 @@ do_memcpy_ssd2gpu(StromCmd__MemCopySsdToGpu *karg,
 	/* sanity checks */
 	if ((karg->chunk_sz & (PAGE_CACHE_SIZE - 1)) != 0 ||	/* alignment */
 		karg->chunk_sz < PAGE_CACHE_SIZE ||					/* >= 4KB */
-		karg->chunk_sz > NVMESSD_DMAREQ_MAXSZ)				/* <= 128KB */
+		karg->chunk_sz > NVMESSD_DMAREQ_MAXSZ)				/* <= 2MB */
 		return -EINVAL;
 
+	if (karg->offset > mgmem->map_length - mgmem->map_offset)
+		return -ERANGE;
 	dest_offset = mgmem->map_offset + karg->offset;
-	if (dest_offset + ((size_t)karg->nr_chunks *
-					   (size_t)karg->chunk_sz) > mgmem->map_length)
+	dest_length = (size_t)karg->nr_chunks * (size_t)karg->chunk_sz;
+	if (dest_offsets_in)
+	{
+		retval = strom_check_dest_offsets(dest_offsets_in,
+										  karg->nr_chunks,
+										  karg->chunk_sz,
+										  mgmem->map_length - dest_offset,
+										  &dest_length);
+		if (retval)
+			return retval;
+	}
+	if (dest_length > mgmem->map_length - dest_offset)
 		return -ERANGE;
 
-	i_size = i_size_read(filp->f_inode);
+	i_size = i_size_read(filp->f_mapping->host);
 	for (i=0; i < karg->nr_chunks; i++)
 	{
 		loff_t			chunk_id = chunk_ids_in[i];
@@ -1537,38 +4375,60 @@ do_memcpy_ssd2gpu(StromCmd__MemCopySsdToGpu *karg,
 				score += (PageDirty(fpage) ? threshold + 1 : 1);
 		}
 
-		if (score > threshold)
-		{
-			/*
-			 * Write-back of file pages if majority of the chunk is cached,
-			 * then application shall call cuMemcpyHtoD for RAM2GPU DMA.
-			 */
-			karg->nr_ram2gpu++;
-			dest_uaddr = karg->wb_buffer +
-				karg->chunk_sz * (karg->nr_chunks - karg->nr_ram2gpu);
-			retval = memcpy_pgcache_to_ubuffer(dtask,
-											   filp,
-											   fpos,
-											   nr_pages,
-											   dest_uaddr);
-			chunk_ids_out[karg->nr_chunks -
-						  karg->nr_ram2gpu] = (uint32_t)chunk_id;
-		}
-		else
+		retval = 0;
+		if (score <= threshold)
 		{
+			loff_t		curr_offset = dest_offset;
+
+			if (dest_offsets_in)
+				curr_offset = (mgmem->map_offset + karg->offset +
+							   dest_offsets_in[i]);
 			retval = memcpy_from_nvme_ssd(dtask,
 										  f_inode,
-										  i_sb->s_bdev,
+										  strom_file_bdev(filp),
 										  fpos,
 										  nr_pages,
-										  dest_offset,
+										  curr_offset,
 										  0,
 										  submit_ssd2gpu_memcpy,
 										  &karg->nr_dma_submit,
 										  &karg->nr_dma_blocks);
-			chunk_ids_out[karg->nr_ssd2gpu] = (uint32_t)chunk_id;
-			dest_offset += karg->chunk_sz;
-			karg->nr_ssd2gpu++;
+			if (!retval)
+			{
+				if (dest_offsets_in)
+					dest_offsets_out[karg->nr_ssd2gpu] = dest_offsets_in[i];
+				chunk_ids_out[karg->nr_ssd2gpu] = (uint32_t)chunk_id;
+				dest_offset += karg->chunk_sz;
+				karg->nr_ssd2gpu++;
+			}
+		}
+
+		/*
+		 * Write-back of file pages if majority of the chunk is cached,
+		 * then application shall call cuMemcpyHtoD for RAM2GPU DMA.
+		 * GPU device memory cannot be filled up by CPU, so chunks with
+		 * holes or unwritten extents are also written back from the page
+		 * cache, which reads them as zero.
+		 */
+		if (score > threshold || retval == -ENODATA)
+		{
+			karg->nr_ram2gpu++;
+			if (dest_offsets_in)
+			{
+				dest_uaddr = karg->wb_buffer + dest_offsets_in[i];
+				dest_offsets_out[karg->nr_chunks -
+								 karg->nr_ram2gpu] = dest_offsets_in[i];
+			}
+			else
+				dest_uaddr = karg->wb_buffer +
+					karg->chunk_sz * (karg->nr_chunks - karg->nr_ram2gpu);
+			retval = memcpy_pgcache_to_ubuffer(dtask,
+											   filp,
+											   fpos,
+											   nr_pages,
+											   dest_uaddr);
+			chunk_ids_out[karg->nr_chunks -
+						  karg->nr_ram2gpu] = (uint32_t)chunk_id;
 		}
 
 		/*
@@ -1604,79 +4464,133 @@ do_memcpy_ssd2gpu(StromCmd__MemCopySsdToGpu *karg,
 }
 
 /*
- * ioctl(2) handler for STROM_IOCTL__MEMCPY_SSD2GPU
+ * __memcpy_ssd2gpu - common part of STROM_IOCTL__MEMCPY_SSD2GPU and
+ * STROM_IOCTL__MEMCPY_BATCH. Caller has to supply @chunk_ids_buf; at
+ * least 2 * karg->nr_chunks items.
  */
 static int
-ioctl_memcpy_ssd2gpu(StromCmd__MemCopySsdToGpu __user *uarg,
-					 struct file *ioctl_filp)
+__memcpy_ssd2gpu(StromCmd__MemCopySsdToGpu *karg,
+				 StromCmd__MemCopySsdToGpu __user *uarg,
+				 strom_dma_source *dsrc,
+				 uint32_t *chunk_ids_buf,
+				 struct file *ioctl_filp)
 {
-	StromCmd__MemCopySsdToGpu karg;
 	mapped_gpu_memory  *mgmem;
 	strom_dma_task	   *dtask;
-	uint32_t		   *chunk_ids_in = NULL;
-	uint32_t		   *chunk_ids_out = NULL;
+	uint32_t		   *chunk_ids_in = chunk_ids_buf;
+	uint32_t		   *chunk_ids_out = chunk_ids_buf + karg->nr_chunks;
+	uint64_t		   *dest_offsets_in = NULL;
+	uint64_t		   *dest_offsets_out = NULL;
 	int					retval;
 
-	if (copy_from_user(&karg, uarg, sizeof(StromCmd__MemCopySsdToGpu)))
+	if (copy_from_user(chunk_ids_in, karg->chunk_ids,
+					   sizeof(uint32_t) * karg->nr_chunks))
 		return -EFAULT;
-	chunk_ids_in = kmalloc(2 * sizeof(uint32_t) * karg.nr_chunks, GFP_KERNEL);
-	if (!chunk_ids_in)
-		return -ENOMEM;
-	if (copy_from_user(chunk_ids_in, karg.chunk_ids,
-					   sizeof(uint32_t) * karg.nr_chunks))
+	if (karg->dest_offsets)
 	{
-		retval = -EFAULT;
-		goto out;
+		dest_offsets_in = kmalloc(2 * sizeof(uint64_t) *
+								  Max(karg->nr_chunks, 1), GFP_KERNEL);
+		if (!dest_offsets_in)
+			return -ENOMEM;
+		dest_offsets_out = dest_offsets_in + karg->nr_chunks;
+		if (copy_from_user(dest_offsets_in, karg->dest_offsets,
+						   sizeof(uint64_t) * karg->nr_chunks))
+		{
+			retval = -EFAULT;
+			goto out;
+		}
 	}
-	chunk_ids_out = chunk_ids_in + karg.nr_chunks;
 
 	/* setup DMA task with mapped GPU memory */
-	mgmem = strom_get_mapped_gpu_memory(karg.handle);
+	mgmem = strom_get_mapped_gpu_memory(karg->handle);
 	if (!mgmem)
 	{
 		retval = -ENOENT;
 		goto out;
 	}
 
-	dtask = strom_create_dma_task(karg.file_desc,
-								  mgmem, NULL, ioctl_filp);
+	retval = strom_get_dma_source(dsrc, karg->file_desc);
+	if (retval)
+	{
+		strom_put_mapped_gpu_memory(mgmem);
+		goto out;
+	}
+
+	dtask = strom_create_dma_task(dsrc, mgmem, NULL, ioctl_filp);
 	if (IS_ERR(dtask))
 	{
 		strom_put_mapped_gpu_memory(mgmem);
 		retval = PTR_ERR(dtask);
 		goto out;
 	}
-	karg.dma_task_id = dtask->dma_task_id;
-	karg.nr_ram2gpu = 0;
-	karg.nr_ssd2gpu = 0;
-	karg.nr_dma_submit = 0;
-	karg.nr_dma_blocks = 0;
-	
-	retval = do_memcpy_ssd2gpu(&karg, dtask,
-							   chunk_ids_in,
-							   chunk_ids_out);
-	/* no more async jobs shall not acquire the @dtask any more */
-	dtask->frozen = true;
-	barrier();
-
-	strom_put_dma_task(dtask, 0);
+	karg->dma_task_id = dtask->dma_task_id;
+	karg->nr_ram2gpu = 0;
+	karg->nr_ssd2gpu = 0;
+	karg->nr_dma_submit = 0;
+	karg->nr_dma_blocks = 0;
 
+	retval = do_memcpy_ssd2gpu(karg, dtask,
+							   chunk_ids_in,
+							   chunk_ids_out,
+							   dest_offsets_in,
+							   dest_offsets_out);
 	/* write back the results */
 	if (!retval)
 	{
-		if (copy_to_user(uarg, &karg,
+		if (copy_to_user(uarg, karg,
 						 offsetof(StromCmd__MemCopySsdToGpu, handle)))
 			retval = -EFAULT;
-		else if (copy_to_user(karg.chunk_ids, chunk_ids_out,
-							  sizeof(uint32_t) * karg.nr_chunks))
+		else if (copy_to_user(karg->chunk_ids, chunk_ids_out,
+							  sizeof(uint32_t) * karg->nr_chunks))
+			retval = -EFAULT;
+		else if (dest_offsets_out &&
+				 copy_to_user(karg->dest_offsets, dest_offsets_out,
+							  sizeof(uint64_t) * karg->nr_chunks))
 			retval = -EFAULT;
 	}
+	strom_setup_dma_completion(dtask, karg->nr_dma_submit,
+							   karg->nr_dma_blocks, retval);
+	/* no more async jobs shall not acquire the @dtask any more */
+	dtask->frozen = true;
+	barrier();
+
+	strom_put_dma_task(dtask, 0);
+
 	/* synchronization of completion if any error */
 	if (retval)
-		strom_dma_task_wait(karg.dma_task_id, NULL,
-							TASK_UNINTERRUPTIBLE);
+		strom_dma_task_wait(ioctl_filp, karg->dma_task_id, NULL,
+							TASK_UNINTERRUPTIBLE, false);
 out:
-	kfree(chunk_ids_in);
+	kfree(dest_offsets_in);
+	return retval;
+}
+
+/*
+ * ioctl(2) handler for STROM_IOCTL__MEMCPY_SSD2GPU
+ */
+static int
+ioctl_memcpy_ssd2gpu(StromCmd__MemCopySsdToGpu __user *uarg,
+					 struct file *ioctl_filp,
+					 size_t usize)
+{
+	StromCmd__MemCopySsdToGpu karg;
+	strom_dma_source	dsrc;
+	uint32_t		   *chunk_ids_buf;
+	int					retval;
+
+	memset(&karg, 0, sizeof(StromCmd__MemCopySsdToGpu));
+	if (copy_from_user(&karg, uarg, usize))
+		return -EFAULT;
+	chunk_ids_buf = kmalloc(2 * sizeof(uint32_t) * karg.nr_chunks, GFP_KERNEL);
+	if (!chunk_ids_buf)
+		return -ENOMEM;
+
+	strom_init_dma_source(&dsrc);
+	retval = __memcpy_ssd2gpu(&karg, uarg, &dsrc,
+							  chunk_ids_buf, ioctl_filp);
+	strom_put_dma_source(&dsrc);
+	kfree(chunk_ids_buf);
+
 	return retval;
 }
 
@@ -1687,6 +4601,96 @@ out:
  * ================================================================
  */
 
+/*
+ * submit_ssd2ram_memcpy_runs - submit DMA from SSD blocks to the multiple
+ * destination runs of the host mapped buffer
+ */
+static int
+submit_ssd2ram_memcpy_runs(strom_dma_task *dtask)
+{
+	strom_dma_buffer   *sd_buf = dtask->sd_buf;
+	struct nvme_ns	   *nvme_ns = dtask->nvme_ns;
+	struct nvme_ctrl   *nvme_ctrl = nvme_ns->ctrl;
+	strom_prps_item	   *pitem;
+	struct page		   *ppage;
+	size_t				total_nbytes = 0;
+	bool				use_sgl = strom_nvme_use_sgl(nvme_ns);
+	long				i, j, k, n;
+	int					retval;
+	u64					tv1, tv2;
+
+	/* PRPs list can scatter the blocks only by PAGE_SIZE */
+	if (!use_sgl && nvme_ctrl->page_size != PAGE_SIZE)
+		return -EINVAL;
+	for (i=0; i < dtask->nr_dest_runs; i++)
+	{
+		strom_dest_run *drun = &dtask->dest_runs[i];
+		size_t		len = (size_t)drun->nr_pages << PAGE_SHIFT;
+
+		if (drun->dest_offset != -1 &&
+			(drun->dest_offset < 0 ||
+			 (drun->dest_offset & (PAGE_SIZE - 1)) != 0 ||
+			 len > sd_buf->length ||
+			 drun->dest_offset > sd_buf->length - len))
+			return -ERANGE;
+		total_nbytes += len;
+	}
+	if (total_nbytes != SECTOR_SIZE * dtask->nr_sectors)
+		return -EINVAL;
+
+	tv1 = rdtsc();
+	pitem = strom_prps_item_alloc();
+	if (!pitem)
+		return -ENOMEM;
+
+	for (i=0; i < dtask->nr_dest_runs; i++)
+	{
+		strom_dest_run *drun = &dtask->dest_runs[i];
+		loff_t		dest_offset = drun->dest_offset;
+
+		for (n=0; n < drun->nr_pages; n++, dest_offset += PAGE_SIZE)
+		{
+			if (drun->dest_offset == -1)
+				ppage = strom_scratch_page;
+			else
+			{
+				j = (dest_offset >> PAGE_SHIFT) / sd_buf->segment_sz;
+				k = (dest_offset >> PAGE_SHIFT) % sd_buf->segment_sz;
+				ppage = sd_buf->dma_segments[j] + k;
+			}
+			if (use_sgl)
+				strom_prps_item_append_sgl(pitem, page_to_phys(ppage),
+										   PAGE_SIZE);
+			else
+				strom_prps_item_append(pitem, page_to_phys(ppage),
+									   nvme_ctrl->page_size);
+		}
+	}
+	if (stat_info)
+	{
+		tv2 = rdtsc();
+		atomic64_inc(&stat_nr_setup_prps);
+		atomic64_add((u64)(tv2 > tv1 ? tv2 - tv1 : 0), &stat_clk_setup_prps);
+	}
+
+	tv1 = rdtsc();
+	retval = __submit_async_read_cmd(dtask, pitem);
+	if (retval)
+		strom_prps_item_free(pitem);
+	if (stat_info)
+	{
+		long	curval;
+
+		tv2 = rdtsc();
+		atomic64_inc(&stat_nr_submit_dma);
+		atomic64_add((u64)(tv2 > tv1 ? tv2 - tv1 : 0), &stat_clk_submit_dma);
+
+		curval = atomic64_inc_return(&stat_cur_dma_count);
+		atomic64_max_return(curval, &stat_max_dma_count);
+	}
+	return retval;
+}
+
 /*
  * submit_ssd2ram_memcpy - submit DMA from SSD blocks to host mapped buffer
  */
@@ -1700,7 +4704,7 @@ submit_ssd2ram_memcpy(strom_dma_task *dtask)
 	strom_prps_item	   *pitem;
 	ssize_t				total_nbytes;
 	long				dest_offset;
-	long				i, j, k;
+	long				j, k;
 	int					retval;
 	u64					tv1, tv2;
 
@@ -1708,8 +4712,11 @@ submit_ssd2ram_memcpy(strom_dma_task *dtask)
 	WARN_ON((dtask->dest_offset & (PAGE_SIZE - 1)) != 0);
 
 	total_nbytes = SECTOR_SIZE * dtask->nr_sectors;
-	if (!total_nbytes || total_nbytes > NVMESSD_DMAREQ_MAXSZ)
+	if (!total_nbytes ||
+		total_nbytes > SECTOR_SIZE * strom_nvme_max_sectors(nvme_ns))
 		return -EINVAL;
+	if (dtask->nr_dest_runs > 0)
+		return submit_ssd2ram_memcpy_runs(dtask);
 	if (dtask->dest_offset < 0 ||
 		dtask->dest_offset + total_nbytes > sd_buf->length)
 		return -ERANGE;
@@ -1721,19 +4728,38 @@ submit_ssd2ram_memcpy(strom_dma_task *dtask)
 
 	/* setup PRPS item */
 	dest_offset = dtask->dest_offset;
-	for (i=0; total_nbytes > 0; i++)
+	if (strom_nvme_use_sgl(nvme_ns))
 	{
-		size_t	len = Min(total_nbytes, nvme_ctrl->page_size);
-
-		Assert(i < pitem->nrooms);
-		j = (dest_offset >> PAGE_SHIFT) / sd_buf->segment_sz;
-		k = (dest_offset >> PAGE_SHIFT) % sd_buf->segment_sz;
-		ppage = sd_buf->dma_segments[j] + k;
-		pitem->prps_list[i] = page_to_phys(ppage);
-		dest_offset += len;
-		total_nbytes -= len;
+		/* one SGL descriptor per segment of the buffer */
+		while (total_nbytes > 0)
+		{
+			size_t	len;
+
+			j = (dest_offset >> PAGE_SHIFT) / sd_buf->segment_sz;
+			k = (dest_offset >> PAGE_SHIFT) % sd_buf->segment_sz;
+			len = Min(total_nbytes,
+					  ((size_t)(sd_buf->segment_sz - k) << PAGE_SHIFT));
+			ppage = sd_buf->dma_segments[j] + k;
+			strom_prps_item_append_sgl(pitem, page_to_phys(ppage), len);
+			dest_offset += len;
+			total_nbytes -= len;
+		}
+	}
+	else
+	{
+		while (total_nbytes > 0)
+		{
+			size_t	len = Min(total_nbytes, nvme_ctrl->page_size);
+
+			j = (dest_offset >> PAGE_SHIFT) / sd_buf->segment_sz;
+			k = (dest_offset >> PAGE_SHIFT) % sd_buf->segment_sz;
+			ppage = sd_buf->dma_segments[j] + k;
+			strom_prps_item_append(pitem, page_to_phys(ppage),
+								   nvme_ctrl->page_size);
+			dest_offset += len;
+			total_nbytes -= len;
+		}
 	}
-	pitem->nitems = i;
 
 	if (stat_info)
 	{
@@ -1754,9 +4780,370 @@ submit_ssd2ram_memcpy(strom_dma_task *dtask)
 		atomic64_inc(&stat_nr_submit_dma);
 		atomic64_add((u64)(tv2 > tv1 ? tv2 - tv1 : 0), &stat_clk_submit_dma);
 
-		curval = atomic64_inc_return(&stat_cur_dma_count);
-		atomic64_max_return(curval, &stat_max_dma_count);
+		curval = atomic64_inc_return(&stat_cur_dma_count);
+		atomic64_max_return(curval, &stat_max_dma_count);
+	}
+	return retval;
+}
+
+/*
+ * strom_ssd2ram_page - a page of SSD2RAM DMA, to be sorted by the physical
+ * location on the NVMe-SSD devices.
+ */
+typedef struct strom_ssd2ram_page
+{
+	struct nvme_ns	   *nvme_ns;
+	struct gendisk	   *vol_disk;	/* md/dm volume, if any */
+	sector_t			sector;
+	loff_t				dest_offset;
+} strom_ssd2ram_page;
+
+static int
+strom_ssd2ram_page_comp(const void *__a, const void *__b)
+{
+	const strom_ssd2ram_page *a = __a;
+	const strom_ssd2ram_page *b = __b;
+
+	if (a->nvme_ns != b->nvme_ns)
+		return (a->nvme_ns < b->nvme_ns ? -1 : 1);
+	if (a->sector != b->sector)
+		return (a->sector < b->sector ? -1 : 1);
+	return 0;
+}
+
+/*
+ * strom_ssd2ram_map_pages - resolves the location of @nr_pages pages from
+ * @fpos, and appends them to @spages to be sorted later. Holes are filled
+ * up by CPU here, so they are not appended.
+ */
+static int
+strom_ssd2ram_map_pages(strom_dma_task *dtask,
+						struct inode *f_inode,
+						struct block_device *blkdev,
+						strom_block_cursor *bcur,
+						loff_t fpos,
+						int nr_pages,
+						loff_t dest_offset,
+						strom_ssd2ram_page *spages,
+						long *p_nr_spages)
+{
+	int		j, retval;
+
+	for (j=0; j < nr_pages; j++)
+	{
+		strom_ssd2ram_page *spage = &spages[*p_nr_spages];
+		struct nvme_ns *nvme_ns;
+		bool		is_hole;
+
+		if (strom_copy_cached_page(dtask, dest_offset, dtask->file_pages[j]))
+		{
+			fpos += PAGE_CACHE_SIZE;
+			dest_offset += PAGE_CACHE_SIZE;
+			continue;
+		}
+		nvme_ns = strom_map_file_page(dtask, f_inode, blkdev, fpos,
+									  bcur, &spage->sector, &is_hole);
+		if (IS_ERR(nvme_ns))
+			return PTR_ERR(nvme_ns);
+		if (is_hole)
+		{
+			retval = strom_fill_dma_buffer_page(dtask->sd_buf, dest_offset,
+												dtask->file_pages[j]);
+			if (retval)
+				return retval;
+		}
+		else
+		{
+			spage->nvme_ns = (nvme_ns ? nvme_ns : dtask->nvme_ns);
+			spage->vol_disk = dtask->vol_disk;
+			spage->dest_offset = dest_offset;
+			(*p_nr_spages)++;
+		}
+		fpos += PAGE_CACHE_SIZE;
+		dest_offset += PAGE_CACHE_SIZE;
+	}
+	return 0;
+}
+
+/*
+ * submit_ssd2ram_sorted_pages - sorts the pages by (device, sector), and
+ * merges the adjacent ones into a READ command even if they are not
+ * adjacent on the destination buffer; the PRPs list or SGL scatters the
+ * blocks to the caller specified destination.
+ * If @merge_gap_kb of the command, or max_merge_gap_kb module parameter
+ * if 0, is set, pages separated by a small gap are also merged, and the
+ * blocks in the gap are read into the scratch page. These blocks are not
+ * counted in *p_nr_dma_blocks, but in the bytes_gap_waste statistics.
+ */
+static int
+submit_ssd2ram_sorted_pages(strom_dma_task *dtask,
+							strom_ssd2ram_page *spages,
+							long nr_spages,
+							unsigned int merge_gap_kb,
+							unsigned int *p_nr_dma_submit,
+							unsigned int *p_nr_dma_blocks)
+{
+	unsigned int		nr_sects = (PAGE_CACHE_SIZE >> SECTOR_SHIFT);
+	sector_t			max_gap_sects;
+	sector_t			gap_sects;
+	sector_t			pending_gap_sects = 0;
+	bool				mergeable;
+	long				i;
+	int					retval = 0;
+
+	if (merge_gap_kb == 0)
+		merge_gap_kb = Max(max_merge_gap_kb, 0);
+	max_gap_sects = ((sector_t)merge_gap_kb << 10) >> SECTOR_SHIFT;
+	dtask->dest_runs = kmalloc(sizeof(strom_dest_run) *
+							   (NVMESSD_DMAREQ_MAXSZ >> PAGE_SHIFT),
+							   GFP_KERNEL);
+	if (!dtask->dest_runs)
+		return -ENOMEM;
+	dtask->nr_dest_runs = 0;
+
+	sort(spages, nr_spages, sizeof(strom_ssd2ram_page),
+		 strom_ssd2ram_page_comp, NULL);
+	for (i=0; i < nr_spages; i++)
+	{
+		strom_ssd2ram_page *spage = &spages[i];
+
+		/*
+		 * The page is mergeable to the pending request if it is adjacent,
+		 * or the gap is small enough and aligned to PAGE_SIZE.
+		 */
+		mergeable = false;
+		gap_sects = 0;
+		if (dtask->nr_sectors > 0 &&
+			dtask->nvme_ns == spage->nvme_ns &&
+			dtask->head_sector + dtask->nr_sectors <= spage->sector)
+		{
+			gap_sects = (spage->sector -
+						 (dtask->head_sector + dtask->nr_sectors));
+			if (gap_sects <= max_gap_sects &&
+				(gap_sects & ((PAGE_SIZE >> SECTOR_SHIFT) - 1)) == 0 &&
+				dtask->nr_sectors + gap_sects + nr_sects <=
+				strom_nvme_max_sectors(dtask->nvme_ns))
+				mergeable = true;
+		}
+
+		if (mergeable)
+		{
+			strom_dest_run *drun;
+
+			if (gap_sects > 0)
+			{
+				drun = &dtask->dest_runs[dtask->nr_dest_runs++];
+				drun->dest_offset = -1;
+				drun->nr_pages = (gap_sects >> (PAGE_SHIFT - SECTOR_SHIFT));
+				dtask->nr_sectors += gap_sects;
+				pending_gap_sects += gap_sects;
+				if (stat_info)
+				{
+					atomic64_inc(&stat_nr_gap_merge);
+					atomic64_add(gap_sects << SECTOR_SHIFT,
+								 &stat_bytes_gap_waste);
+				}
+			}
+			drun = &dtask->dest_runs[dtask->nr_dest_runs-1];
+			if (drun->dest_offset != -1 &&
+				drun->dest_offset +
+				((loff_t)drun->nr_pages << PAGE_SHIFT) == spage->dest_offset)
+				drun->nr_pages++;
+			else
+			{
+				drun = &dtask->dest_runs[dtask->nr_dest_runs++];
+				drun->dest_offset = spage->dest_offset;
+				drun->nr_pages = 1;
+			}
+			dtask->nr_sectors += nr_sects;
+		}
+		else
+		{
+			if (dtask->nr_sectors > 0)
+			{
+				(*p_nr_dma_submit)++;
+				(*p_nr_dma_blocks) += dtask->nr_sectors - pending_gap_sects;
+				retval = submit_ssd2ram_memcpy(dtask);
+				if (retval)
+				{
+					prError("submit_ssd2ram_memcpy: %d", retval);
+					goto out;
+				}
+			}
+			pending_gap_sects = 0;
+			dtask->nvme_ns = spage->nvme_ns;
+			dtask->vol_disk = spage->vol_disk;
+			dtask->dest_offset = spage->dest_offset;
+			dtask->head_sector = spage->sector;
+			dtask->nr_sectors = nr_sects;
+			dtask->dest_runs[0].dest_offset = spage->dest_offset;
+			dtask->dest_runs[0].nr_pages = 1;
+			dtask->nr_dest_runs = 1;
+		}
+	}
+	/* submit pending SSD2RAM DMA request, if any */
+	if (dtask->nr_sectors > 0)
+	{
+		(*p_nr_dma_submit)++;
+		(*p_nr_dma_blocks) += dtask->nr_sectors - pending_gap_sects;
+		retval = submit_ssd2ram_memcpy(dtask);
+	}
+out:
+	kfree(dtask->dest_runs);
+	dtask->dest_runs = NULL;
+	dtask->nr_dest_runs = 0;
+	return retval;
+}
+
+/*
+ * strom_ssd2ram_threshold - threshold of the score of a chunk, to copy
+ * the cached pages by CPU. The score counts the cached pages, and a dirty
+ * page makes it over the threshold.
+ */
+static inline int
+strom_ssd2ram_threshold(unsigned int flags, unsigned int hybrid_ratio,
+						int nr_pages)
+{
+	if ((flags & STROM_MEMCPY_SSD2RAM__HYBRID) != 0 && hybrid_ratio > 0)
+		return (nr_pages * hybrid_ratio) / 100;
+	return nr_pages / 2;
+}
+
+/*
+ * do_memcpy_ssd2ram_sorted - SSD-to-RAM DMA in the physical order
+ *
+ * It resolves the location of all the chunks first, then submits them
+ * in the physical order by submit_ssd2ram_sorted_pages().
+ */
+static int
+do_memcpy_ssd2ram_sorted(StromCmd__MemCopySsdToRam *karg,
+						 strom_dma_task *dtask,
+						 size_t dest_offset,
+						 size_t i_size,
+						 uint32_t *chunk_ids,
+						 uint64_t *dest_offsets)
+{
+	struct file		   *filp = dtask->filp;
+	struct inode	   *f_inode = filp->f_inode;
+	struct block_device *blkdev = strom_file_bdev(filp);
+	char __user		   *dest_uaddr;
+	loff_t				curr_offset;
+	unsigned int		nr_pages = (karg->chunk_sz >> PAGE_CACHE_SHIFT);
+	bool				hybrid = ((karg->flags &
+								   STROM_MEMCPY_SSD2RAM__HYBRID) != 0);
+	int					threshold = strom_ssd2ram_threshold(karg->flags,
+															karg->hybrid_ratio,
+															nr_pages);
+	strom_ssd2ram_page *spages;
+	size_t				spages_sz;
+	long				nr_spages = 0;
+	strom_block_cursor	bcur;
+	long				i, j, k;
+	int					retval = 0;
+
+	spages_sz = sizeof(strom_ssd2ram_page) *
+		(size_t)karg->nr_chunks * (size_t)nr_pages;
+	if (spages_sz <= 4 * PAGE_SIZE)
+		spages = kmalloc(spages_sz, GFP_KERNEL);
+	else
+		spages = vmalloc(spages_sz);
+	if (!spages)
+		return -ENOMEM;
+
+	/* resolve the location of the chunks, or copy from the page cache */
+	memset(&bcur, 0, sizeof(strom_block_cursor));
+	for (i=0; i < karg->nr_chunks; i++)
+	{
+		loff_t			chunk_id = chunk_ids[i];
+		loff_t			fpos;
+		struct page	   *fpage;
+		int				score = 0;
+		int				nr_uptodate = 0;
+
+		if (karg->relseg_sz == 0)
+			fpos = chunk_id * (size_t)karg->chunk_sz;
+		else
+			fpos = (chunk_id % karg->relseg_sz) * (size_t)karg->chunk_sz;
+		Assert((fpos & (PAGE_CACHE_SIZE - 1)) == 0);
+		if (fpos > i_size)
+		{
+			prError("fpos=%ld i_size=%zu", (long)fpos, i_size);
+			retval = -ERANGE;
+			goto out;
+		}
+		curr_offset = (dest_offsets ? dest_offsets[i] :
+					   i * (size_t)karg->chunk_sz);
+		dest_uaddr = (char __user *)karg->dest_uaddr + curr_offset;
+		curr_offset += dest_offset;
+
+		for (j=0, k=(fpos >> PAGE_CACHE_SHIFT); j < nr_pages; j++, k++)
+		{
+			fpage = find_lock_page(filp->f_mapping, k);
+			dtask->file_pages[j] = fpage;
+			if (fpage)
+			{
+				score += (PageDirty(fpage) ? threshold + 1 : 1);
+				if (PageUptodate(fpage))
+					nr_uptodate++;
+			}
+		}
+
+		if (score > threshold && !hybrid)
+		{
+			retval = memcpy_pgcache_to_ubuffer(dtask,
+											   filp,
+											   fpos,
+											   nr_pages,
+											   dest_uaddr);
+			karg->nr_ram2ram++;
+		}
+		else
+		{
+			dtask->copy_cached = (score > threshold);
+			retval = strom_ssd2ram_map_pages(dtask,
+											 f_inode,
+											 blkdev,
+											 &bcur,
+											 fpos,
+											 nr_pages,
+											 curr_offset,
+											 spages,
+											 &nr_spages);
+			if (dtask->copy_cached && nr_uptodate == nr_pages)
+				karg->nr_ram2ram++;
+			else
+				karg->nr_ssd2ram++;
+			dtask->copy_cached = false;
+		}
+
+		if (score > 0)
+		{
+			for (j=0; j < nr_pages; j++)
+			{
+				fpage = dtask->file_pages[j];
+				if (fpage)
+				{
+					unlock_page(fpage);
+					page_cache_release(fpage);
+				}
+			}
+		}
+
+		if (retval)
+			goto out;
 	}
+
+	/* merge the physically adjacent pages, then submit */
+	retval = submit_ssd2ram_sorted_pages(dtask, spages, nr_spages,
+										 karg->max_merge_gap_kb,
+										 &karg->nr_dma_submit,
+										 &karg->nr_dma_blocks);
+	Assert(karg->nr_ram2ram + karg->nr_ssd2ram == karg->nr_chunks);
+out:
+	if (is_vmalloc_addr(spages))
+		vfree(spages);
+	else
+		kfree(spages);
 	return retval;
 }
 
@@ -1766,15 +5153,22 @@ submit_ssd2ram_memcpy(strom_dma_task *dtask)
 static int
 do_memcpy_ssd2ram(StromCmd__MemCopySsdToRam *karg,
 				  strom_dma_task *dtask,
-				  size_t dest_offset, uint32_t *chunk_ids)
+				  size_t dest_offset,
+				  size_t dest_length,
+				  uint32_t *chunk_ids,
+				  uint64_t *dest_offsets)
 {
 	strom_dma_buffer   *sd_buf = dtask->sd_buf;
 	struct file		   *filp = dtask->filp;
 	struct inode	   *f_inode = filp->f_inode;
-	struct super_block *i_sb = f_inode->i_sb;
-	char __user		   *dest_uaddr = karg->dest_uaddr;
+	char __user		   *dest_uaddr;
+	loff_t				curr_offset;
 	unsigned int		nr_pages = (karg->chunk_sz >> PAGE_CACHE_SHIFT);
-	int					threshold = nr_pages / 2;
+	bool				hybrid = ((karg->flags &
+								   STROM_MEMCPY_SSD2RAM__HYBRID) != 0);
+	int					threshold = strom_ssd2ram_threshold(karg->flags,
+															karg->hybrid_ratio,
+															nr_pages);
 	size_t				i_size;
 	size_t				dest_segment_sz;
 	long				i, j, k;
@@ -1783,28 +5177,33 @@ do_memcpy_ssd2ram(StromCmd__MemCopySsdToRam *karg,
 	/* sanity checks */
 	if ((karg->chunk_sz & (PAGE_CACHE_SIZE - 1)) != 0 ||	/* alignment */
 		karg->chunk_sz < PAGE_CACHE_SIZE ||					/* >= 4KB */
-		karg->chunk_sz > NVMESSD_DMAREQ_MAXSZ ||			/* <= 128KB */
-		(dest_offset & (PAGE_CACHE_SIZE - 1)) != 0)			/* alignment */
+		karg->chunk_sz > NVMESSD_DMAREQ_MAXSZ ||			/* <= 2MB */
+		(dest_offset & (PAGE_CACHE_SIZE - 1)) != 0 ||		/* alignment */
+		karg->hybrid_ratio > 100)							/* percentage */
 		return -EINVAL;
-	if (dest_offset + ((size_t)karg->chunk_sz *
-					   (size_t)karg->nr_chunks) > sd_buf->length)
-	{
-		prError("dest_offset=%lu-%lu buflen=%zu",
-				dest_offset,
-				dest_offset + ((size_t)karg->chunk_sz *
-							   (size_t)karg->nr_chunks),
-				sd_buf->length);
+	if (dest_offset > sd_buf->length ||
+		dest_length > sd_buf->length - dest_offset)
+	{
+		prError("dest_offset=%zu length=%zu buflen=%zu",
+				dest_offset, dest_length, sd_buf->length);
 		return -ERANGE;
 	}
 
 	dest_segment_sz = (size_t)sd_buf->segment_sz * (size_t)PAGE_SIZE;
-	i_size = i_size_read(f_inode);
+	i_size = i_size_read(filp->f_mapping->host);
+	if ((karg->flags & STROM_MEMCPY_SSD2RAM__SORTED) != 0)
+		return do_memcpy_ssd2ram_sorted(karg, dtask, dest_offset,
+										i_size, chunk_ids, dest_offsets);
+	retval = strom_setup_stripe_slots(dtask);
+	if (retval)
+		return retval;
 	for (i=0; i < karg->nr_chunks; i++)
 	{
 		loff_t			chunk_id = chunk_ids[i];
 		loff_t			fpos;
 		struct page	   *fpage;
 		int				score = 0;
+		int				nr_uptodate = 0;
 
 		if (karg->relseg_sz == 0)
 			fpos = chunk_id * (size_t)karg->chunk_sz;
@@ -1816,16 +5215,24 @@ do_memcpy_ssd2ram(StromCmd__MemCopySsdToRam *karg,
 			prError("fpos=%ld i_size=%zu", (long)fpos, i_size);
 			return -ERANGE;
 		}
+		curr_offset = (dest_offsets ? dest_offsets[i] :
+					   i * (size_t)karg->chunk_sz);
+		dest_uaddr = (char __user *)karg->dest_uaddr + curr_offset;
+		curr_offset += dest_offset;
 
 		for (j=0, k=(fpos >> PAGE_CACHE_SHIFT); j < nr_pages; j++, k++)
 		{
 			fpage = find_lock_page(filp->f_mapping, k);
 			dtask->file_pages[j] = fpage;
 			if (fpage)
+			{
 				score += (PageDirty(fpage) ? threshold + 1 : 1);
+				if (PageUptodate(fpage))
+					nr_uptodate++;
+			}
 		}
 
-		if (score > threshold)
+		if (score > threshold && !hybrid)
 		{
 			retval = memcpy_pgcache_to_ubuffer(dtask,
 											   filp,
@@ -1836,17 +5243,22 @@ do_memcpy_ssd2ram(StromCmd__MemCopySsdToRam *karg,
 		}
 		else
 		{
+			dtask->copy_cached = (score > threshold);
 			retval = memcpy_from_nvme_ssd(dtask,
 										  f_inode,
-										  i_sb->s_bdev,
+										  strom_file_bdev(filp),
 										  fpos,
 										  nr_pages,
-										  dest_offset,
+										  curr_offset,
 										  dest_segment_sz,
 										  submit_ssd2ram_memcpy,
 										  &karg->nr_dma_submit,
 										  &karg->nr_dma_blocks);
-			karg->nr_ssd2ram++;
+			if (dtask->copy_cached && nr_uptodate == nr_pages)
+				karg->nr_ram2ram++;
+			else
+				karg->nr_ssd2ram++;
+			dtask->copy_cached = false;
 		}
 
 		/*
@@ -1868,9 +5280,13 @@ do_memcpy_ssd2ram(StromCmd__MemCopySsdToRam *karg,
 
 		if (retval)
 			return retval;
-		dest_uaddr += (size_t)karg->chunk_sz;
-		dest_offset += (size_t)karg->chunk_sz;
 	}
+	/* submit pending requests of md-raid0 members, if any */
+	if (dtask->stripe_slots)
+		retval = strom_flush_stripe_slots(dtask,
+										  submit_ssd2ram_memcpy,
+										  &karg->nr_dma_submit,
+										  &karg->nr_dma_blocks);
 	/* submit pending SSD2RAM DMA request, if any */
 	if (dtask->nr_sectors > 0)
 	{
@@ -1883,103 +5299,862 @@ do_memcpy_ssd2ram(StromCmd__MemCopySsdToRam *karg,
 	return retval;
 }
 
+/*
+ * strom_create_ssd2ram_task - looks up the mapped DMA buffer at @dest_uaddr,
+ * and creates a DMA task that holds the buffer. @dest_length bytes from
+ * @dest_uaddr must be mapped. Offset of @dest_uaddr in the buffer is set
+ * on *p_dest_offset.
+ */
+static strom_dma_task *
+strom_create_ssd2ram_task(strom_dma_source *dsrc,
+						  unsigned long dest_uaddr,
+						  size_t dest_length,
+						  size_t *p_dest_offset,
+						  struct file *ioctl_filp)
+{
+	struct vm_area_struct  *vma = NULL;
+	struct mm_struct	   *mm = current->mm;
+	strom_dma_buffer	   *sd_buf;
+	strom_dma_task		   *dtask;
+
+	/*
+	 * lookup destination buffer; which should be mapped DMA buffer
+	 * and range is preliminary mapped to user application.
+	 */
+	down_read(&mm->mmap_sem);
+	vma = find_vma(mm, dest_uaddr);
+	if (!vma || !vma->vm_file ||
+		vma->vm_file->f_op != &strom_dma_buffer_fops)
+	{
+		up_read(&mm->mmap_sem);
+		return ERR_PTR(-EINVAL);
+	}
+	if (dest_uaddr < vma->vm_start ||
+		dest_length > vma->vm_end - dest_uaddr)
+	{
+		up_read(&mm->mmap_sem);
+		prError("uaddr(%p) length=%zu vm(%p-%p)",
+				(void *)(dest_uaddr),
+				dest_length,
+				(void *)vma->vm_start,
+				(void *)vma->vm_end);
+		return ERR_PTR(-ERANGE);
+	}
+	*p_dest_offset = vma->vm_pgoff * PAGE_SIZE + (dest_uaddr - vma->vm_start);
+	sd_buf = get_strom_dma_buffer(vma->vm_private_data);
+	up_read(&mm->mmap_sem);
+
+	/* setup DMA task with mapped host DMA buffer */
+	dtask = strom_create_dma_task(dsrc, NULL, sd_buf, ioctl_filp);
+	if (IS_ERR(dtask))
+		put_strom_dma_buffer(sd_buf);
+	return dtask;
+}
+
+/*
+ * __memcpy_ssd2ram - common part of STROM_IOCTL__MEMCPY_SSD2RAM and
+ * STROM_IOCTL__MEMCPY_BATCH. Caller has to supply @chunk_ids; at least
+ * karg->nr_chunks items.
+ */
+static int
+__memcpy_ssd2ram(StromCmd__MemCopySsdToRam *karg,
+				 StromCmd__MemCopySsdToRam __user *uarg,
+				 strom_dma_source *dsrc,
+				 uint32_t *chunk_ids,
+				 struct file *ioctl_filp)
+{
+	strom_dma_task		   *dtask;
+	size_t					dest_offset;
+	size_t					dest_length;
+	uint64_t			   *dest_offsets = NULL;
+	int						retval = 0;
+
+	if (copy_from_user(chunk_ids, karg->chunk_ids,
+					   sizeof(uint32_t) * karg->nr_chunks))
+		return -EFAULT;
+	dest_length = (size_t)karg->nr_chunks * (size_t)karg->chunk_sz;
+	if (karg->dest_offsets)
+	{
+		dest_offsets = kmalloc(sizeof(uint64_t) *
+							   Max(karg->nr_chunks, 1), GFP_KERNEL);
+		if (!dest_offsets)
+			return -ENOMEM;
+		if (copy_from_user(dest_offsets, karg->dest_offsets,
+						   sizeof(uint64_t) * karg->nr_chunks))
+		{
+			retval = -EFAULT;
+			goto out;
+		}
+	}
+
+	/*
+	 * Offsets are checked with no limit here, to get the length of the
+	 * destination to be mapped.
+	 */
+	if (dest_offsets)
+	{
+		retval = strom_check_dest_offsets(dest_offsets,
+										  karg->nr_chunks,
+										  karg->chunk_sz,
+										  SIZE_MAX,
+										  &dest_length);
+		if (retval)
+			goto out;
+	}
+
+	retval = strom_get_dma_source(dsrc, karg->file_desc);
+	if (retval)
+		goto out;
+
+	dtask = strom_create_ssd2ram_task(dsrc, (unsigned long)karg->dest_uaddr,
+									  dest_length, &dest_offset, ioctl_filp);
+	if (IS_ERR(dtask))
+	{
+		retval = PTR_ERR(dtask);
+		goto out;
+	}
+	karg->dma_task_id = dtask->dma_task_id;
+	karg->nr_ram2ram = 0;
+	karg->nr_ssd2ram = 0;
+	karg->nr_dma_submit = 0;
+	karg->nr_dma_blocks = 0;
+
+	retval = do_memcpy_ssd2ram(karg, dtask, dest_offset, dest_length,
+							   chunk_ids, dest_offsets);
+	strom_release_stripe_slots(dtask);
+	/* write back the results */
+	if (!retval)
+	{
+		if (copy_to_user(uarg, karg,
+						 offsetof(StromCmd__MemCopySsdToRam, dest_uaddr)))
+			retval = -EFAULT;
+	}
+	strom_setup_dma_completion(dtask, karg->nr_dma_submit,
+							   karg->nr_dma_blocks, retval);
+	/* no more async task shall acquire the @dtask any more */
+	dtask->frozen = true;
+	barrier();
+
+	strom_put_dma_task(dtask, 0);
+
+	/* synchronization of completion if any error */
+	if (retval)
+		strom_dma_task_wait(ioctl_filp, karg->dma_task_id, NULL,
+							TASK_UNINTERRUPTIBLE, false);
+out:
+	kfree(dest_offsets);
+	return retval;
+}
+
 /*
  * ioctl_memcpy_ssd2ram - handler for STROM_IOCTL__MEMCPY_SSD2RAM
  */
 static int
 ioctl_memcpy_ssd2ram(StromCmd__MemCopySsdToRam __user *uarg,
-					 struct file *ioctl_filp)
+					 struct file *ioctl_filp,
+					 size_t usize)
+{
+	StromCmd__MemCopySsdToRam karg;
+	strom_dma_source	dsrc;
+	uint32_t		   *chunk_ids;
+	int					retval;
+
+	/* copy ioctl arguments from the userspace */
+	memset(&karg, 0, sizeof(karg));
+	if (copy_from_user(&karg, uarg, usize))
+		return -EFAULT;
+	chunk_ids = kmalloc(sizeof(uint32_t) * karg.nr_chunks, GFP_KERNEL);
+	if (!chunk_ids)
+		return -ENOMEM;
+
+	strom_init_dma_source(&dsrc);
+	retval = __memcpy_ssd2ram(&karg, uarg, &dsrc, chunk_ids, ioctl_filp);
+	strom_put_dma_source(&dsrc);
+	kfree(chunk_ids);
+
+	return retval;
+}
+
+/*
+ * strom_lookup_dma_source - looks up the source file of the range from the
+ * sources already checked, or returns NULL if not found.
+ */
+static strom_dma_source *
+strom_lookup_dma_source(strom_dma_source *dsrcs, int nr_dsrcs, int fdesc)
+{
+	int		i;
+
+	for (i=0; i < nr_dsrcs; i++)
+	{
+		if (dsrcs[i].fdesc == fdesc)
+			return &dsrcs[i];
+	}
+	return NULL;
+}
+
+/*
+ * strom_dma_task_switch_source - switches the current source file of the
+ * multi-file DMA task. Caller has to submit the pending request prior to
+ * switching to the file on another block device.
+ */
+static void
+strom_dma_task_switch_source(strom_dma_task *dtask, strom_dma_source *dsrc)
+{
+	dtask->mddev = dsrc->mddev;
+	dtask->raid0_geom = dsrc->raid0_geom;
+	dtask->dm_md = dsrc->dm_md;
+	dtask->dm_target_hint = 0;
+	if (!dsrc->mddev && !dsrc->dm_md)
+	{
+		struct gendisk *bd_disk = strom_file_bdev(dsrc->filp)->bd_disk;
+
+		dtask->nvme_ns = (struct nvme_ns *)bd_disk->private_data;
+		dtask->vol_disk = NULL;
+	}
+	else
+		dtask->vol_disk = strom_file_bdev(dsrc->filp)->bd_disk;
+}
+
+static int
+strom_memcpy_range_comp(const void *__a, const void *__b)
+{
+	const StromMemCopyRange *a = __a;
+	const StromMemCopyRange *b = __b;
+
+	if (a->dest_offset != b->dest_offset)
+		return (a->dest_offset < b->dest_offset ? -1 : 1);
+	return 0;
+}
+
+/*
+ * strom_check_dest_ranges - checks the destination of the ranges does not
+ * overlap each other. Ranges are sorted on a copy, not to change the order
+ * of the ranges to be read.
+ */
+static int
+strom_check_dest_ranges(StromMemCopyRange *ranges, unsigned int nr_ranges)
+{
+	StromMemCopyRange  *temp;
+	size_t				temp_sz = sizeof(StromMemCopyRange) * nr_ranges;
+	unsigned int		i;
+	int					retval = 0;
+
+	if (temp_sz <= 4 * PAGE_SIZE)
+		temp = kmalloc(temp_sz, GFP_KERNEL);
+	else
+		temp = vmalloc(temp_sz);
+	if (!temp)
+		return -ENOMEM;
+	memcpy(temp, ranges, temp_sz);
+	sort(temp, nr_ranges, sizeof(StromMemCopyRange),
+		 strom_memcpy_range_comp, NULL);
+	for (i=1; i < nr_ranges; i++)
+	{
+		if (temp[i].dest_offset < temp[i-1].dest_offset + temp[i-1].length)
+		{
+			retval = -EINVAL;
+			break;
+		}
+	}
+	if (is_vmalloc_addr(temp))
+		vfree(temp);
+	else
+		kfree(temp);
+	return retval;
+}
+
+/*
+ * do_memcpy_ssd2ram_ranges - main part of SSD-to-RAM DMA by byte ranges
+ *
+ * Each range is processed by units up to NVMESSD_DMAREQ_MAXSZ, aligned to
+ * the file offset; a unit mostly cached is copied from the page cache, and
+ * the others are read by DMA, like the chunks of do_memcpy_ssd2ram().
+ * @dsrcs are the source files; ranges are associated by the file
+ * descriptor if STROM_MEMCPY_SSD2RAM__MULTI_FILES, elsewhere all the
+ * ranges come from @dsrcs[0].
+ */
+static int
+do_memcpy_ssd2ram_ranges(StromCmd__MemCopySsdToRamRanges *karg,
+						 strom_dma_task *dtask,
+						 size_t dest_offset,
+						 size_t dest_length,
+						 StromMemCopyRange *ranges,
+						 strom_dma_source *dsrcs,
+						 int nr_dsrcs)
+{
+	strom_dma_buffer   *sd_buf = dtask->sd_buf;
+	strom_dma_source   *dsrc;
+	struct file		   *filp = NULL;
+	struct inode	   *f_inode = NULL;
+	struct block_device *blkdev = NULL;
+	bool				multi_files;
+	bool				hybrid;
+	strom_ssd2ram_page *spages = NULL;
+	size_t				spages_sz = 0;
+	long				nr_spages = 0;
+	strom_block_cursor	bcur;
+	size_t				i_size;
+	size_t				dest_segment_sz;
+	long				i, j, k;
+	int					retval = 0;
+
+	if (dest_offset > sd_buf->length ||
+		dest_length > sd_buf->length - dest_offset)
+	{
+		prError("dest_offset=%zu length=%zu buflen=%zu",
+				dest_offset, dest_length, sd_buf->length);
+		return -ERANGE;
+	}
+	multi_files = ((karg->flags & STROM_MEMCPY_SSD2RAM__MULTI_FILES) != 0);
+	hybrid = ((karg->flags & STROM_MEMCPY_SSD2RAM__HYBRID) != 0);
+	if (karg->hybrid_ratio > 100)
+		return -EINVAL;
+	for (i=0; i < karg->nr_ranges; i++)
+	{
+		StromMemCopyRange  *range = &ranges[i];
+
+		dsrc = (multi_files
+				? strom_lookup_dma_source(dsrcs, nr_dsrcs, range->file_desc)
+				: &dsrcs[0]);
+		Assert(dsrc != NULL);
+		i_size = PAGE_CACHE_ALIGN(i_size_read(dsrc->filp->f_mapping->host));
+		if (range->file_pos + range->length > i_size)
+		{
+			prError("fpos=%lu-%lu i_size=%zu",
+					(unsigned long)range->file_pos,
+					(unsigned long)(range->file_pos + range->length),
+					i_size);
+			return -ERANGE;
+		}
+		spages_sz += sizeof(strom_ssd2ram_page) *
+			(range->length >> PAGE_CACHE_SHIFT);
+	}
+
+	if ((karg->flags & STROM_MEMCPY_SSD2RAM__SORTED) != 0 && spages_sz > 0)
+	{
+		/*
+		 * Pages are read in the order of sectors, so the destination of
+		 * the ranges must not overlap. Then, @spages never exceeds the
+		 * pages of the destination.
+		 */
+		retval = strom_check_dest_ranges(ranges, karg->nr_ranges);
+		if (retval)
+			return retval;
+		if (spages_sz > sizeof(strom_ssd2ram_page) *
+			(dest_length >> PAGE_CACHE_SHIFT))
+			return -ERANGE;
+		if (spages_sz <= 4 * PAGE_SIZE)
+			spages = kmalloc(spages_sz, GFP_KERNEL);
+		else
+			spages = vmalloc(spages_sz);
+		if (!spages)
+			return -ENOMEM;
+	}
+
+	dest_segment_sz = (size_t)sd_buf->segment_sz * (size_t)PAGE_SIZE;
+	for (i=0; i < karg->nr_ranges; i++)
+	{
+		StromMemCopyRange  *range = &ranges[i];
+		loff_t		fpos = range->file_pos;
+		loff_t		curr_offset = dest_offset + range->dest_offset;
+		char __user *dest_uaddr = (char __user *)karg->dest_uaddr +
+			range->dest_offset;
+		size_t		remain = range->length;
+
+		/* switch the source file, if needed */
+		dsrc = (multi_files
+				? strom_lookup_dma_source(dsrcs, nr_dsrcs, range->file_desc)
+				: &dsrcs[0]);
+		if (dsrc->filp != filp)
+		{
+			/*
+			 * The pending request can be merged with the blocks of another
+			 * file only if both files are on the same block device.
+			 */
+			if (!spages && strom_file_bdev(dsrc->filp) != blkdev)
+			{
+				if (dtask->stripe_slots)
+				{
+					retval = strom_flush_stripe_slots(dtask,
+													  submit_ssd2ram_memcpy,
+													  &karg->nr_dma_submit,
+													  &karg->nr_dma_blocks);
+					strom_release_stripe_slots(dtask);
+				}
+				else if (dtask->nr_sectors > 0)
+				{
+					karg->nr_dma_submit++;
+					karg->nr_dma_blocks += dtask->nr_sectors;
+					retval = submit_ssd2ram_memcpy(dtask);
+					dtask->nr_sectors = 0;
+				}
+				if (retval)
+					goto out;
+			}
+			strom_dma_task_switch_source(dtask, dsrc);
+			filp = dsrc->filp;
+			f_inode = filp->f_inode;
+			blkdev = strom_file_bdev(filp);
+			memset(&bcur, 0, sizeof(strom_block_cursor));
+			if (!spages && !dtask->stripe_slots)
+			{
+				retval = strom_setup_stripe_slots(dtask);
+				if (retval)
+					goto out;
+			}
+		}
+
+		while (remain > 0)
+		{
+			struct page *fpage;
+			size_t		unitsz;
+			int			nr_pages;
+			int			threshold;
+			int			score = 0;
+			int			nr_uptodate = 0;
+
+			unitsz = NVMESSD_DMAREQ_MAXSZ -
+				(fpos & (NVMESSD_DMAREQ_MAXSZ - 1));
+			unitsz = Min(unitsz, remain);
+			nr_pages = (unitsz >> PAGE_CACHE_SHIFT);
+			threshold = strom_ssd2ram_threshold(karg->flags,
+												karg->hybrid_ratio,
+												nr_pages);
+
+			for (j=0, k=(fpos >> PAGE_CACHE_SHIFT); j < nr_pages; j++, k++)
+			{
+				fpage = find_lock_page(filp->f_mapping, k);
+				dtask->file_pages[j] = fpage;
+				if (fpage)
+				{
+					score += (PageDirty(fpage) ? threshold + 1 : 1);
+					if (PageUptodate(fpage))
+						nr_uptodate++;
+				}
+			}
+			dtask->copy_cached = (hybrid && score > threshold);
+
+			if (score > threshold && !hybrid)
+			{
+				retval = memcpy_pgcache_to_ubuffer(dtask,
+												   filp,
+												   fpos,
+												   nr_pages,
+												   dest_uaddr);
+				karg->nr_ram2ram++;
+			}
+			else
+			{
+				if (spages)
+					retval = strom_ssd2ram_map_pages(dtask,
+													 f_inode,
+													 blkdev,
+													 &bcur,
+													 fpos,
+													 nr_pages,
+													 curr_offset,
+													 spages,
+													 &nr_spages);
+				else
+					retval = memcpy_from_nvme_ssd(dtask,
+												  f_inode,
+												  blkdev,
+												  fpos,
+												  nr_pages,
+												  curr_offset,
+												  dest_segment_sz,
+												  submit_ssd2ram_memcpy,
+												  &karg->nr_dma_submit,
+												  &karg->nr_dma_blocks);
+				if (dtask->copy_cached && nr_uptodate == nr_pages)
+					karg->nr_ram2ram++;
+				else
+					karg->nr_ssd2ram++;
+			}
+			dtask->copy_cached = false;
+
+			if (score > 0)
+			{
+				for (j=0; j < nr_pages; j++)
+				{
+					fpage = dtask->file_pages[j];
+					if (fpage)
+					{
+						unlock_page(fpage);
+						page_cache_release(fpage);
+					}
+				}
+			}
+
+			if (retval)
+				goto out;
+			fpos += unitsz;
+			curr_offset += unitsz;
+			dest_uaddr += unitsz;
+			remain -= unitsz;
+		}
+	}
+
+	if (spages)
+		retval = submit_ssd2ram_sorted_pages(dtask, spages, nr_spages,
+											 karg->max_merge_gap_kb,
+											 &karg->nr_dma_submit,
+											 &karg->nr_dma_blocks);
+	else if (dtask->stripe_slots)
+		retval = strom_flush_stripe_slots(dtask,
+										  submit_ssd2ram_memcpy,
+										  &karg->nr_dma_submit,
+										  &karg->nr_dma_blocks);
+	else if (dtask->nr_sectors > 0)
+	{
+		/* submit pending SSD2RAM DMA request, if any */
+		karg->nr_dma_submit++;
+		karg->nr_dma_blocks += dtask->nr_sectors;
+		retval = submit_ssd2ram_memcpy(dtask);
+	}
+out:
+	if (spages)
+	{
+		if (is_vmalloc_addr(spages))
+			vfree(spages);
+		else
+			kfree(spages);
+	}
+	return retval;
+}
+
+/*
+ * ioctl_memcpy_ssd2ram_ranges - handler for STROM_IOCTL__MEMCPY_SSD2RAM_RANGES
+ */
+static int
+ioctl_memcpy_ssd2ram_ranges(StromCmd__MemCopySsdToRamRanges __user *uarg,
+							struct file *ioctl_filp)
 {
-	StromCmd__MemCopySsdToRam karg;
-	struct vm_area_struct  *vma = NULL;
-	struct mm_struct	   *mm = current->mm;
-	strom_dma_buffer	   *sd_buf;
-	strom_dma_task		   *dtask;
-	uint32_t			   *chunk_ids;
-	unsigned long			dest_uaddr;
-	size_t					dest_offset;
-	int						retval = 0;
+	StromCmd__MemCopySsdToRamRanges karg;
+	StromMemCopyRange  *ranges;
+	size_t				ranges_sz;
+	strom_dma_source   *dsrcs;
+	int					nr_dsrcs = 0;
+	int					max_dsrcs = 1;
+	strom_dma_task	   *dtask;
+	size_t				dest_offset;
+	size_t				dest_length = 0;
+	unsigned int		i;
+	int					retval = 0;
 
 	/* copy ioctl arguments from the userspace */
 	if (copy_from_user(&karg, uarg, sizeof(karg)))
 		return -EFAULT;
-	chunk_ids = kmalloc(sizeof(uint32_t) * karg.nr_chunks, GFP_KERNEL);
-	if (!chunk_ids)
+	if (karg.nr_ranges == 0)
+		return -EINVAL;
+	if (karg.nr_ranges > STROM_MEMCPY_RANGES_MAXSZ)
+		return -E2BIG;
+	if ((karg.flags & STROM_MEMCPY_SSD2RAM__MULTI_FILES) != 0)
+		max_dsrcs = STROM_MEMCPY_RANGES_MAXFILES;
+	ranges_sz = sizeof(StromMemCopyRange) * karg.nr_ranges;
+	if (ranges_sz <= 4 * PAGE_SIZE)
+		ranges = kmalloc(ranges_sz, GFP_KERNEL);
+	else
+		ranges = vmalloc(ranges_sz);
+	if (!ranges)
 		return -ENOMEM;
-	if (copy_from_user(chunk_ids, karg.chunk_ids,
-					   sizeof(uint32_t) * karg.nr_chunks))
+	dsrcs = kmalloc(sizeof(strom_dma_source) * max_dsrcs, GFP_KERNEL);
+	if (!dsrcs)
+	{
+		retval = -ENOMEM;
+		goto out_free;
+	}
+	if (copy_from_user(ranges, karg.ranges, ranges_sz))
 	{
 		retval = -EFAULT;
-		goto out;
+		goto out_free;
 	}
 
-	/*
-	 * lookup destination buffer; which should be mapped DMA buffer
-	 * and range is preliminary mapped to user application.
-	 */
-	down_read(&mm->mmap_sem);
-	dest_uaddr = (unsigned long)karg.dest_uaddr;
-	vma = find_vma(mm, dest_uaddr);
-	if (!vma || !vma->vm_file ||
-		vma->vm_file->f_op != &strom_dma_buffer_fops)
+	/* sanity checks */
+	for (i=0; i < karg.nr_ranges; i++)
 	{
-		up_read(&mm->mmap_sem);
-		retval = -EINVAL;
-		goto out;
+		StromMemCopyRange  *range = &ranges[i];
+
+		if (((range->file_pos |
+			  range->length |
+			  range->dest_offset) & (PAGE_CACHE_SIZE - 1)) != 0 ||
+			range->length == 0)
+		{
+			retval = -EINVAL;
+			goto out_free;
+		}
+		if (range->file_pos + range->length < range->file_pos ||
+			range->dest_offset + range->length < range->dest_offset)
+		{
+			retval = -ERANGE;
+			goto out_free;
+		}
+		dest_length = Max(dest_length, range->dest_offset + range->length);
 	}
 
-	if (dest_uaddr < vma->vm_start ||
-		dest_uaddr + ((size_t)karg.nr_chunks *
-					  (size_t)karg.chunk_sz) > vma->vm_end)
+	/* lookup and check the source files */
+	for (i=0; i < karg.nr_ranges; i++)
 	{
-		up_read(&mm->mmap_sem);
-		retval = -ERANGE;
-		prError("uaddr(%p-%p) vm(%p-%p)",
-				(void *)(dest_uaddr),
-				(void *)(dest_uaddr + (size_t)karg.nr_chunks * (size_t)karg.chunk_sz),
-				(void *)vma->vm_start,
-				(void *)vma->vm_end);
-		goto out;
+		int		fdesc = (max_dsrcs > 1 ? ranges[i].file_desc : karg.file_desc);
+
+		if (strom_lookup_dma_source(dsrcs, nr_dsrcs, fdesc))
+			continue;
+		if (nr_dsrcs >= max_dsrcs)
+		{
+			retval = -E2BIG;
+			goto out_put;
+		}
+		strom_init_dma_source(&dsrcs[nr_dsrcs]);
+		retval = strom_get_dma_source(&dsrcs[nr_dsrcs], fdesc);
+		if (retval)
+			goto out_put;
+		nr_dsrcs++;
 	}
-	dest_offset = vma->vm_pgoff * PAGE_SIZE + (dest_uaddr - vma->vm_start);
-	sd_buf = get_strom_dma_buffer(vma->vm_private_data);
-	up_read(&mm->mmap_sem);
 
-	/* setup DMA task with mapped host DMA buffer */
-	dtask = strom_create_dma_task(karg.file_desc,
-								  NULL, sd_buf, ioctl_filp);
+	dtask = strom_create_ssd2ram_task(&dsrcs[0],
+									  (unsigned long)karg.dest_uaddr,
+									  dest_length, &dest_offset, ioctl_filp);
 	if (IS_ERR(dtask))
 	{
 		retval = PTR_ERR(dtask);
-		goto out;
+		goto out_put;
+	}
+	/* DMA task also holds the other source files until completion */
+	if (nr_dsrcs > 1)
+	{
+		dtask->extra_filps = kmalloc(sizeof(struct file *) *
+									 (nr_dsrcs - 1), GFP_KERNEL);
+		if (!dtask->extra_filps)
+			retval = -ENOMEM;
+		else
+		{
+			for (i=1; i < nr_dsrcs; i++)
+				dtask->extra_filps[dtask->nr_extra_filps++]
+					= get_file(dsrcs[i].filp);
+		}
 	}
 	karg.dma_task_id = dtask->dma_task_id;
 	karg.nr_ram2ram = 0;
 	karg.nr_ssd2ram = 0;
+	karg.nr_dma_submit = 0;
+	karg.nr_dma_blocks = 0;
 
-	retval = do_memcpy_ssd2ram(&karg, dtask, dest_offset, chunk_ids);
-	/* no more async task shall acquire the @dtask any more */
-	dtask->frozen = true;
-	barrier();
-
-	strom_put_dma_task(dtask, 0);
-
+	if (!retval)
+		retval = do_memcpy_ssd2ram_ranges(&karg, dtask, dest_offset,
+										  dest_length, ranges,
+										  dsrcs, nr_dsrcs);
+	strom_release_stripe_slots(dtask);
 	/* write back the results */
 	if (!retval)
 	{
 		if (copy_to_user(uarg, &karg,
-						 offsetof(StromCmd__MemCopySsdToRam, dest_uaddr)))
+						 offsetof(StromCmd__MemCopySsdToRamRanges,
+								  dest_uaddr)))
 			retval = -EFAULT;
 	}
+	strom_setup_dma_completion(dtask, karg.nr_dma_submit,
+							   karg.nr_dma_blocks, retval);
+	/* no more async task shall acquire the @dtask any more */
+	dtask->frozen = true;
+	barrier();
+
+	strom_put_dma_task(dtask, 0);
+
 	/* synchronization of completion if any error */
 	if (retval)
-		strom_dma_task_wait(karg.dma_task_id, NULL,
-							TASK_UNINTERRUPTIBLE);
-out:
+		strom_dma_task_wait(ioctl_filp, karg.dma_task_id, NULL,
+							TASK_UNINTERRUPTIBLE, false);
+out_put:
+	while (nr_dsrcs > 0)
+		strom_put_dma_source(&dsrcs[--nr_dsrcs]);
+out_free:
+	kfree(dsrcs);
+	if (is_vmalloc_addr(ranges))
+		vfree(ranges);
+	else
+		kfree(ranges);
+	return retval;
+}
+
+/*
+ * ioctl_memcpy_batch - handler for STROM_IOCTL__MEMCPY_BATCH
+ *
+ * It submits multiple SSD2GPU or SSD2RAM commands by one system call.
+ * Array of the commands is copied at once, and a buffer for chunk_ids is
+ * allocated once for the largest command. The source file is looked up
+ * and checked only when file descriptor is changed from the previous one.
+ * On errors, it stops at the failed command, then @nr_done tells caller
+ * how many commands were already submitted; these DMA tasks are running,
+ * thus caller still has to wait for them.
+ */
+static int
+ioctl_memcpy_batch(StromCmd__MemCopyBatch __user *uarg,
+				   struct file *ioctl_filp)
+{
+	StromCmd__MemCopyBatch karg;
+	strom_dma_source	dsrc;
+	size_t				unitsz;
+	char			   *kcmds;
+	char __user		   *ucmds;
+	uint32_t		   *chunk_ids;
+	size_t				max_chunks = 0;
+	unsigned int		i;
+	int					retval = 0;
+
+	if (copy_from_user(&karg, uarg, sizeof(StromCmd__MemCopyBatch)))
+		return -EFAULT;
+	if (karg.command == STROM_IOCTL__MEMCPY_SSD2GPU)
+		unitsz = sizeof(StromCmd__MemCopySsdToGpu);
+	else if (karg.command == STROM_IOCTL__MEMCPY_SSD2RAM)
+		unitsz = sizeof(StromCmd__MemCopySsdToRam);
+	else
+		return -EINVAL;
+	if (karg.nr_cmds > STROM_MEMCPY_BATCH_MAXSZ)
+		return -E2BIG;
+	karg.nr_done = 0;
+	if (karg.nr_cmds == 0)
+		goto out;
+
+	kcmds = kmalloc(unitsz * karg.nr_cmds, GFP_KERNEL);
+	if (!kcmds)
+		return -ENOMEM;
+	ucmds = karg.cmds;
+	if (copy_from_user(kcmds, ucmds, unitsz * karg.nr_cmds))
+	{
+		retval = -EFAULT;
+		goto out_free_cmds;
+	}
+
+	/* one chunk_ids buffer, for the largest command */
+	for (i=0; i < karg.nr_cmds; i++)
+	{
+		if (karg.command == STROM_IOCTL__MEMCPY_SSD2GPU)
+			max_chunks = Max(max_chunks, 2 * (size_t)
+							 ((StromCmd__MemCopySsdToGpu *)
+							  (kcmds + i * unitsz))->nr_chunks);
+		else
+			max_chunks = Max(max_chunks, (size_t)
+							 ((StromCmd__MemCopySsdToRam *)
+							  (kcmds + i * unitsz))->nr_chunks);
+	}
+	chunk_ids = kmalloc(sizeof(uint32_t) * Max(max_chunks, 1), GFP_KERNEL);
+	if (!chunk_ids)
+	{
+		retval = -ENOMEM;
+		goto out_free_cmds;
+	}
+
+	strom_init_dma_source(&dsrc);
+	for (i=0; i < karg.nr_cmds; i++)
+	{
+		if (karg.command == STROM_IOCTL__MEMCPY_SSD2GPU)
+			retval = __memcpy_ssd2gpu((void *)(kcmds + i * unitsz),
+									  (void __user *)(ucmds + i * unitsz),
+									  &dsrc, chunk_ids, ioctl_filp);
+		else
+			retval = __memcpy_ssd2ram((void *)(kcmds + i * unitsz),
+									  (void __user *)(ucmds + i * unitsz),
+									  &dsrc, chunk_ids, ioctl_filp);
+		if (retval)
+			break;
+		karg.nr_done++;
+	}
+	strom_put_dma_source(&dsrc);
 	kfree(chunk_ids);
+out_free_cmds:
+	kfree(kcmds);
+out:
+	if (put_user(karg.nr_done, &uarg->nr_done))
+		retval = -EFAULT;
 	return retval;
 }
 
+/*
+ * ioctl_setup_completion_ring - handler for STROM_IOCTL__SETUP_COMPLETION_RING
+ */
+static int
+ioctl_setup_completion_ring(StromCmd__SetupCompletionRing __user *uarg,
+							struct file *ioctl_filp)
+{
+	StromCmd__SetupCompletionRing karg;
+	strom_proc_state   *pstate = ioctl_filp->private_data;
+	StromCompletionRing *cring;
+	size_t				length;
+	unsigned long		flags;
+
+	if (copy_from_user(&karg, uarg, sizeof(StromCmd__SetupCompletionRing)))
+		return -EFAULT;
+	if (karg.nr_entries < 2 ||
+		karg.nr_entries > (1U << 20) ||
+		(karg.nr_entries & (karg.nr_entries - 1)) != 0)
+		return -EINVAL;
+
+	length = PAGE_ALIGN(offsetof(StromCompletionRing,
+								 entries[karg.nr_entries]));
+	cring = vmalloc_user(length);
+	if (!cring)
+		return -ENOMEM;
+	cring->head = 0;
+	cring->tail = 0;
+	cring->mask = karg.nr_entries - 1;
+	cring->nr_overflow = 0;
+
+	spin_lock_irqsave(&pstate->lock, flags);
+	if (pstate->cring)
+	{
+		spin_unlock_irqrestore(&pstate->lock, flags);
+		vfree(cring);
+		return -EBUSY;
+	}
+	pstate->cring = cring;
+	pstate->cring_sz = length;
+	pstate->cring_mask = karg.nr_entries - 1;
+	spin_unlock_irqrestore(&pstate->lock, flags);
+
+	karg.mmap_length = length;
+	if (copy_to_user(uarg, &karg, sizeof(StromCmd__SetupCompletionRing)))
+		return -EFAULT;
+	return 0;
+}
+
+/*
+ * ioctl_setup_eventfd - handler for STROM_IOCTL__SETUP_EVENTFD
+ *
+ * It attaches an eventfd to the file descriptor, to be signaled on
+ * completion of the DMA tasks submitted on the file descriptor, or
+ * detaches the current one if negative.
+ */
+static int
+ioctl_setup_eventfd(StromCmd__SetupEventFd __user *uarg,
+					struct file *ioctl_filp)
+{
+	strom_proc_state   *pstate = ioctl_filp->private_data;
+	StromCmd__SetupEventFd karg;
+	struct eventfd_ctx *eventfd = NULL;
+	struct eventfd_ctx *oldfd;
+	unsigned long		flags;
+
+	if (copy_from_user(&karg, uarg, sizeof(StromCmd__SetupEventFd)))
+		return -EFAULT;
+	if (karg.eventfd >= 0)
+	{
+		eventfd = eventfd_ctx_fdget(karg.eventfd);
+		if (IS_ERR(eventfd))
+		{
+			prError("file descriptor %d is not eventfd", karg.eventfd);
+			return PTR_ERR(eventfd);
+		}
+	}
+	spin_lock_irqsave(&pstate->lock, flags);
+	oldfd = pstate->eventfd;
+	pstate->eventfd = eventfd;
+	spin_unlock_irqrestore(&pstate->lock, flags);
+
+	if (oldfd)
+		eventfd_ctx_put(oldfd);
+	return 0;
+}
+
 /*
  * STROM_IOCTL__STAT_INFO - Run-time statistics support
  */
@@ -1987,11 +6162,21 @@ static int
 ioctl_stat_info_command(StromCmd__StatInfo __user *uarg)
 {
 	StromCmd__StatInfo	karg;
+	unsigned int		version;
+	size_t				usize;
 
-	if (copy_from_user(&karg, uarg, sizeof(StromCmd__StatInfo)))
+	/* version 1 has the fields up to clk_debug4 */
+	if (get_user(version, &uarg->version))
 		return -EFAULT;
-	if (karg.version != 1)
+	if (version == 1)
+		usize = offsetof(StromCmd__StatInfo, nr_dtask_alloc_hit);
+	else if (version == 2)
+		usize = sizeof(StromCmd__StatInfo);
+	else
 		return -EINVAL;
+	memset(&karg, 0, sizeof(StromCmd__StatInfo));
+	if (copy_from_user(&karg, uarg, usize))
+		return -EFAULT;
 	if (!stat_info)
 		return -ENODATA;
 
@@ -2007,6 +6192,20 @@ ioctl_stat_info_command(StromCmd__StatInfo __user *uarg)
 	karg.nr_wrong_wakeup = atomic64_read(&stat_nr_wrong_wakeup);
 	karg.cur_dma_count	= atomic64_read(&stat_cur_dma_count);
 	karg.max_dma_count	= atomic64_xchg(&stat_max_dma_count, 0UL);
+	karg.nr_dtask_alloc_hit = atomic64_read(&stat_nr_dtask_alloc_hit);
+	karg.nr_dtask_alloc_miss = atomic64_read(&stat_nr_dtask_alloc_miss);
+	karg.nr_cmd_cxt_alloc_hit = atomic64_read(&stat_nr_cmd_cxt_alloc_hit);
+	karg.nr_cmd_cxt_alloc_miss = atomic64_read(&stat_nr_cmd_cxt_alloc_miss);
+	karg.nr_numa_submit_local = atomic64_read(&stat_nr_numa_submit_local);
+	karg.nr_numa_submit_steered = atomic64_read(&stat_nr_numa_submit_steered);
+	karg.nr_numa_complete_local = atomic64_read(&stat_nr_numa_complete_local);
+	karg.nr_numa_complete_remote = atomic64_read(&stat_nr_numa_complete_remote);
+	karg.nr_extent_cache_hit = atomic64_read(&stat_nr_extent_cache_hit);
+	karg.nr_extent_cache_miss = atomic64_read(&stat_nr_extent_cache_miss);
+	karg.nr_gap_merge	= atomic64_read(&stat_nr_gap_merge);
+	karg.bytes_gap_waste = atomic64_read(&stat_bytes_gap_waste);
+	karg.nr_zero_fill	= atomic64_read(&stat_nr_zero_fill);
+	karg.nr_hybrid_copy	= atomic64_read(&stat_nr_hybrid_copy);
 	if (stat_info == 1)
 		karg.has_debug	= 0;
 	else
@@ -2021,12 +6220,123 @@ ioctl_stat_info_command(StromCmd__StatInfo __user *uarg)
 		karg.nr_debug4	= atomic64_read(&stat_nr_debug4);
 		karg.clk_debug4	= atomic64_read(&stat_clk_debug4);
 	}
-	if (copy_to_user(uarg, &karg, sizeof(StromCmd__StatInfo)))
+	if (copy_to_user(uarg, &karg, usize))
 		return -EFAULT;
 
 	return 0;
 }
 
+/*
+ * STROM_IOCTL__STAT_DEVICES - Run-time statistics of each NVMe device
+ */
+static int
+ioctl_stat_devices_command(StromCmd__StatDevices __user *uarg)
+{
+	StromCmd__StatDevices karg;
+	StromDeviceStat	   *dstats = NULL;
+	strom_nvme_dev	   *ndev;
+	size_t				length;
+	unsigned int		nitems = 0;
+	unsigned int		nrooms;
+	bool				reset_max;
+	int					i, j;
+	int					retval = 0;
+
+	if (copy_from_user(&karg, uarg,
+					   offsetof(StromCmd__StatDevices, devices)))
+		return -EFAULT;
+	if (karg.version != 1)
+		return -EINVAL;
+	if (!stat_info)
+		return -ENODATA;
+
+	/*
+	 * An entry of strom_nvme_dev is never released until module unload,
+	 * so the number of entries counted here is enough for the buffer,
+	 * unless a new device gets its first command concurrently.
+	 */
+	rcu_read_lock();
+	for (i=0; i < STROM_NVME_DEV_NSLOTS; i++)
+	{
+		list_for_each_entry_rcu(ndev, &strom_nvme_dev_slots[i], chain)
+			nitems++;
+	}
+	rcu_read_unlock();
+
+	nrooms = Min(karg.nrooms, nitems);
+	if (nrooms > 0)
+	{
+		length = sizeof(StromDeviceStat) * nrooms;
+		if (length <= 4 * PAGE_SIZE)
+			dstats = kzalloc(length, GFP_KERNEL);
+		else
+			dstats = vzalloc(length);
+		if (!dstats)
+			return -ENOMEM;
+	}
+
+	karg.nitems = 0;
+	karg.tsc = rdtsc();
+	spin_lock(&strom_nvme_dev_lock);
+	for (i=0; i < STROM_NVME_DEV_NSLOTS; i++)
+	{
+		list_for_each_entry(ndev, &strom_nvme_dev_slots[i], chain)
+			karg.nitems++;
+	}
+	/*
+	 * @max_inflight is reset only if all the entries fit the buffer.
+	 * On ENOBUFS, caller retries with a larger buffer and discards the
+	 * values returned here, so they must be kept for the next call.
+	 */
+	reset_max = (karg.nitems <= nrooms);
+	for (i=0, j=0; i < STROM_NVME_DEV_NSLOTS; i++)
+	{
+		list_for_each_entry(ndev, &strom_nvme_dev_slots[i], chain)
+		{
+			StromDeviceStat *dstat;
+
+			if (j >= nrooms)
+				break;
+			dstat = &dstats[j++];
+			strlcpy(dstat->disk_name, ndev->disk_name,
+					STROM_DEVICE_NAME_LEN);
+			strlcpy(dstat->volume_name, ndev->vol_name,
+					STROM_DEVICE_NAME_LEN);
+			dstat->nr_cmds		= atomic64_read(&ndev->nr_cmds);
+			dstat->nr_errors	= atomic64_read(&ndev->nr_errors);
+			dstat->bytes_read	= atomic64_read(&ndev->bytes_read);
+			dstat->clk_cmds		= atomic64_read(&ndev->clk_cmds);
+			dstat->clk_ewma		= ACCESS_ONCE(ndev->clk_ewma);
+			dstat->cur_inflight	= atomic_read(&ndev->nr_inflight);
+			if (reset_max)
+				dstat->max_inflight = atomic_xchg(&ndev->max_inflight, 0);
+			else
+				dstat->max_inflight = atomic_read(&ndev->max_inflight);
+		}
+	}
+	spin_unlock(&strom_nvme_dev_lock);
+	if (karg.nitems > karg.nrooms)
+		retval = -ENOBUFS;
+
+	/* write back */
+	if (dstats &&
+		copy_to_user(uarg->devices, dstats,
+					 sizeof(StromDeviceStat) * Min(nrooms, karg.nitems)))
+		retval = -EFAULT;
+	if (copy_to_user(uarg, &karg,
+					 offsetof(StromCmd__StatDevices, devices)))
+		retval = -EFAULT;
+
+	if (dstats)
+	{
+		if (is_vmalloc_addr(dstats))
+			vfree(dstats);
+		else
+			kfree(dstats);
+	}
+	return retval;
+}
+
 /* ================================================================
  *
  * file_operations of '/proc/nvme-strom' entry
@@ -2041,6 +6351,22 @@ static const char  *strom_proc_signature =		\
 static int
 strom_proc_open(struct inode *inode, struct file *filp)
 {
+	strom_proc_state   *pstate;
+
+	pstate = kzalloc(sizeof(strom_proc_state), GFP_KERNEL);
+	if (!pstate)
+		return -ENOMEM;
+	spin_lock_init(&pstate->lock);
+	idr_init(&pstate->task_idr);
+	pstate->cring = NULL;
+	pstate->cring_sz = 0;
+	pstate->cring_mask = 0;
+	pstate->nr_completed = 0;
+	init_waitqueue_head(&pstate->waitq);
+	init_waitqueue_head(&pstate->pollq);
+	pstate->eventfd = NULL;
+	filp->private_data = pstate;
+
 	return 0;
 }
 
@@ -2060,34 +6386,92 @@ strom_proc_read(struct file *filp, char __user *buf, size_t len, loff_t *pos)
 	return len;
 }
 
+/*
+ * strom_proc_release_task - release the failed DMA tasks not reclaimed.
+ * Running tasks hold the file, so only failed ones can remain here.
+ */
+static int
+strom_proc_release_task(int id, void *ptr, void *data)
+{
+	strom_dma_task	   *dtask = ptr;
+
+	Assert(dtask->failed);
+	prNotice("Unreferenced asynchronous SSD2GPU DMA error "
+			 "(dma_task_id: %lu, status=%ld)",
+			 dtask->dma_task_id, dtask->dma_status);
+	strom_objcache_free(&strom_dma_task_cache, dtask);
+	return 0;
+}
+
 static int
 strom_proc_release(struct inode *inode, struct file *filp)
 {
-	int			i;
+	strom_proc_state   *pstate = filp->private_data;
+
+	/* release the error tasks */
+	idr_for_each(&pstate->task_idr, strom_proc_release_task, NULL);
+	idr_destroy(&pstate->task_idr);
+	/* release the completion ring and eventfd */
+	if (pstate->cring)
+		vfree(pstate->cring);
+	if (pstate->eventfd)
+		eventfd_ctx_put(pstate->eventfd);
+	kfree(pstate);
 
-	for (i=0; i < STROM_DMA_TASK_NSLOTS; i++)
-	{
-		spinlock_t		   *lock = &strom_dma_task_locks[i];
-		struct list_head   *slot = &failed_dma_task_slots[i];
-		unsigned long		flags;
-		strom_dma_task	   *dtask;
-		strom_dma_task	   *dnext;
+	return 0;
+}
 
-		spin_lock_irqsave(lock, flags);
-		list_for_each_entry_safe(dtask, dnext, slot, chain)
-		{
-			if (dtask->ioctl_filp == filp)
-			{
-				prNotice("Unreferenced asynchronous SSD2GPU DMA error "
-						 "(dma_task_id: %lu, status=%ld)",
-						 dtask->dma_task_id, dtask->dma_status);
-				list_del_rcu(&dtask->chain);
-				kfree(dtask);
-			}
-		}
-		spin_unlock_irqrestore(lock, flags);
+/*
+ * strom_proc_mmap - maps the completion ring on the user space
+ */
+static int
+strom_proc_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	strom_proc_state   *pstate = filp->private_data;
+	unsigned long		vm_len = vma->vm_end - vma->vm_start;
+
+	if (!pstate->cring)
+	{
+		prError("no completion ring is set up on the file descriptor");
+		return -EINVAL;
 	}
-	return 0;
+	/* available only if MAP_SHARED */
+	if ((vma->vm_flags & (VM_SHARED|VM_MAYSHARE)) == 0)
+	{
+		prError("Only MAP_SHARED is available on mmap(2) to completion ring");
+		return -EINVAL;
+	}
+	if ((vma->vm_pgoff << PAGE_SHIFT) + vm_len > pstate->cring_sz)
+	{
+		prError("vma (%p-%p) is out of the completion ring (size=%zu)",
+				(void *)vma->vm_start,
+				(void *)vma->vm_end - 1,
+				pstate->cring_sz);
+		return -EINVAL;
+	}
+	return remap_vmalloc_range(vma, pstate->cring, vma->vm_pgoff);
+}
+
+/*
+ * strom_proc_poll - POLLIN if completion ring has entries to be consumed
+ */
+static unsigned int
+strom_proc_poll(struct file *filp, poll_table *wait)
+{
+	strom_proc_state   *pstate = filp->private_data;
+	unsigned long		flags;
+	unsigned int		mask = 0;
+
+	poll_wait(filp, &pstate->pollq, wait);
+
+	spin_lock_irqsave(&pstate->lock, flags);
+	if (!pstate->cring)
+		mask = POLLERR;
+	else if (ACCESS_ONCE(pstate->cring->head) != pstate->cring->tail)
+		mask = POLLIN | POLLRDNORM;
+	spin_unlock_irqrestore(&pstate->lock, flags);
+
+	return mask;
 }
 
 static long
@@ -2123,22 +6507,73 @@ strom_proc_ioctl(struct file *ioctl_filp,
 			retval = ioctl_alloc_dma_buffer((void __user *) arg);
 			break;
 
+		case STROM_IOCTL__MEMCPY_SSD2GPU_V1:
+			retval = ioctl_memcpy_ssd2gpu((void __user *) arg, ioctl_filp,
+										  offsetof(StromCmd__MemCopySsdToGpu,
+												   dest_offsets));
+			break;
+
 		case STROM_IOCTL__MEMCPY_SSD2GPU:
-			retval = ioctl_memcpy_ssd2gpu((void __user *) arg, ioctl_filp);
+			retval = ioctl_memcpy_ssd2gpu((void __user *) arg, ioctl_filp,
+										  sizeof(StromCmd__MemCopySsdToGpu));
+			break;
+
+		case STROM_IOCTL__MEMCPY_SSD2RAM_V1:
+			retval = ioctl_memcpy_ssd2ram((void __user *) arg, ioctl_filp,
+										  offsetof(StromCmd__MemCopySsdToRam,
+												   flags));
 			break;
 
 		case STROM_IOCTL__MEMCPY_SSD2RAM:
-			retval = ioctl_memcpy_ssd2ram((void __user *) arg, ioctl_filp);
+			retval = ioctl_memcpy_ssd2ram((void __user *) arg, ioctl_filp,
+										  sizeof(StromCmd__MemCopySsdToRam));
+			break;
+
+		case STROM_IOCTL__MEMCPY_SSD2RAM_RANGES:
+			retval = ioctl_memcpy_ssd2ram_ranges((void __user *) arg,
+												 ioctl_filp);
+			break;
+
+		case STROM_IOCTL__MEMCPY_WAIT_V1:
+			retval = ioctl_memcpy_wait((void __user *) arg, ioctl_filp,
+									   offsetof(StromCmd__MemCopyWait,
+												flags));
 			break;
 
 		case STROM_IOCTL__MEMCPY_WAIT:
-			retval = ioctl_memcpy_wait((void __user *) arg, ioctl_filp);
+			retval = ioctl_memcpy_wait((void __user *) arg, ioctl_filp,
+									   sizeof(StromCmd__MemCopyWait));
+			break;
+
+		case STROM_IOCTL__MEMCPY_BATCH:
+			retval = ioctl_memcpy_batch((void __user *) arg, ioctl_filp);
+			break;
+
+		case STROM_IOCTL__SETUP_COMPLETION_RING:
+			retval = ioctl_setup_completion_ring((void __user *) arg,
+												 ioctl_filp);
+			break;
+
+		case STROM_IOCTL__MEMCPY_CANCEL:
+			retval = ioctl_memcpy_cancel((void __user *) arg, ioctl_filp);
+			break;
+
+		case STROM_IOCTL__SETUP_EVENTFD:
+			retval = ioctl_setup_eventfd((void __user *) arg, ioctl_filp);
+			break;
+
+		case STROM_IOCTL__MEMCPY_WAIT_MULTI:
+			retval = ioctl_memcpy_wait_multi((void __user *) arg, ioctl_filp);
 			break;
 
 		case STROM_IOCTL__STAT_INFO:
 			retval = ioctl_stat_info_command((void __user *) arg);
 			break;
 
+		case STROM_IOCTL__STAT_DEVICES:
+			retval = ioctl_stat_devices_command((void __user *) arg);
+			break;
+
 		default:
 			retval = -EINVAL;
 			break;
@@ -2152,6 +6587,8 @@ static const struct file_operations nvme_strom_fops = {
 	.open			= strom_proc_open,
 	.read			= strom_proc_read,
 	.release		= strom_proc_release,
+	.mmap			= strom_proc_mmap,
+	.poll			= strom_proc_poll,
 	.unlocked_ioctl	= strom_proc_ioctl,
 	.compat_ioctl	= strom_proc_ioctl,
 };
@@ -2168,14 +6605,6 @@ int	__init nvme_strom_init(void)
 		INIT_LIST_HEAD(&strom_mgmem_slots[i]);
 	}
 
-	/* init strom_dma_task_locks/slots */
-	for (i=0; i < STROM_DMA_TASK_NSLOTS; i++)
-	{
-		spin_lock_init(&strom_dma_task_locks[i]);
-		INIT_LIST_HEAD(&strom_dma_task_slots[i]);
-		INIT_LIST_HEAD(&failed_dma_task_slots[i]);
-		init_waitqueue_head(&strom_dma_task_waitq[i]);
-	}
 	/* solve mandatory symbols */
 	rc = strom_init_extra_symbols();
 	if (rc)
@@ -2184,6 +6613,34 @@ int	__init nvme_strom_init(void)
 	rc = strom_init_prps_item_buffer();
 	if (rc)
 		goto error_2;
+	/* init NVMe device states */
+	strom_init_nvme_dev();
+	/* setup object caches for DMA tasks and NVMe command contexts */
+	rc = strom_objcache_init(&strom_dma_task_cache,
+							 "nvme_strom_dma_task",
+							 sizeof(strom_dma_task),
+							 offsetof(strom_dma_task, file_pages),
+							 STROM_OBJCACHE_DTASK_MAXLEN,
+							 &stat_nr_dtask_alloc_hit,
+							 &stat_nr_dtask_alloc_miss);
+	if (rc)
+		goto error_3;
+	rc = strom_objcache_init(&strom_cmd_cxt_cache,
+							 "nvme_strom_cmd_cxt",
+							 sizeof(strom_async_cmd_context),
+							 sizeof(strom_async_cmd_context),
+							 STROM_OBJCACHE_CMD_CXT_MAXLEN,
+							 &stat_nr_cmd_cxt_alloc_hit,
+							 &stat_nr_cmd_cxt_alloc_miss);
+	if (rc)
+		goto error_4;
+	/* scratch page for the gap of merged READ commands */
+	strom_scratch_page = alloc_page(GFP_KERNEL);
+	if (!strom_scratch_page)
+	{
+		rc = -ENOMEM;
+		goto error_5;
+	}
 	/* make "/proc/nvme-strom" entry */
 	nvme_strom_proc = proc_create("nvme-strom",
 								  0444,
@@ -2192,12 +6649,18 @@ int	__init nvme_strom_init(void)
 	if (!nvme_strom_proc)
 	{
 		rc = -ENOMEM;
-		goto error_3;
+		goto error_6;
 	}
 	prNotice("/proc/nvme-strom entry was registered");
 
 	return 0;
 
+error_6:
+	__free_page(strom_scratch_page);
+error_5:
+	strom_objcache_exit(&strom_cmd_cxt_cache);
+error_4:
+	strom_objcache_exit(&strom_dma_task_cache);
 error_3:
 	strom_exit_prps_item_buffer();
 error_2:
@@ -2210,8 +6673,12 @@ module_init(nvme_strom_init);
 void __exit nvme_strom_exit(void)
 {
 	strom_exit_prps_item_buffer();
+	strom_objcache_exit(&strom_cmd_cxt_cache);
+	strom_objcache_exit(&strom_dma_task_cache);
+	strom_exit_nvme_dev();
 	strom_exit_extra_symbols();
 	proc_remove(nvme_strom_proc);
+	__free_page(strom_scratch_page);
 	prNotice("/proc/nvme-strom entry was unregistered");
 }
 module_exit(nvme_strom_exit);
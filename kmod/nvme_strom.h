@@ -14,6 +14,12 @@
 #endif
 #include <asm/ioctl.h>
 
+/*
+ * Once fields are appended to the argument of a command, the command gets
+ * a new number in 0xa0-0xaf with the same low digit, and the former number
+ * is kept as STROM_IOCTL__*_V1. Kernel reads and writes only the fields of
+ * the former layout on the _V1 number, and the appended fields are zero.
+ */
 enum {
 	STROM_IOCTL__CHECK_FILE			= _IO('S',0x80),
 	STROM_IOCTL__MAP_GPU_MEMORY		= _IO('S',0x81),
@@ -21,10 +27,20 @@ enum {
 	STROM_IOCTL__LIST_GPU_MEMORY	= _IO('S',0x83),
 	STROM_IOCTL__INFO_GPU_MEMORY	= _IO('S',0x84),
 	STROM_IOCTL__ALLOC_DMA_BUFFER	= _IO('S',0x85),
-	STROM_IOCTL__MEMCPY_SSD2GPU		= _IO('S',0x90),
-	STROM_IOCTL__MEMCPY_SSD2RAM		= _IO('S',0x91),
-	STROM_IOCTL__MEMCPY_WAIT		= _IO('S',0x92),
+	STROM_IOCTL__MEMCPY_SSD2GPU_V1	= _IO('S',0x90),
+	STROM_IOCTL__MEMCPY_SSD2RAM_V1	= _IO('S',0x91),
+	STROM_IOCTL__MEMCPY_WAIT_V1		= _IO('S',0x92),
+	STROM_IOCTL__MEMCPY_BATCH		= _IO('S',0x93),
+	STROM_IOCTL__SETUP_COMPLETION_RING = _IO('S',0x94),
+	STROM_IOCTL__MEMCPY_WAIT_MULTI	= _IO('S',0x95),
+	STROM_IOCTL__SETUP_EVENTFD		= _IO('S',0x96),
+	STROM_IOCTL__MEMCPY_CANCEL		= _IO('S',0x97),
+	STROM_IOCTL__MEMCPY_SSD2RAM_RANGES = _IO('S',0x98),
 	STROM_IOCTL__STAT_INFO			= _IO('S',0x99),
+	STROM_IOCTL__STAT_DEVICES		= _IO('S',0x9a),
+	STROM_IOCTL__MEMCPY_SSD2GPU		= _IO('S',0xa0),
+	STROM_IOCTL__MEMCPY_SSD2RAM		= _IO('S',0xa1),
+	STROM_IOCTL__MEMCPY_WAIT		= _IO('S',0xa2),
 };
 
 /* path of ioctl(2) entrypoint */
@@ -35,7 +51,7 @@ typedef struct StromCmd__CheckFile
 {
 	int				fdesc;		/* in: file descriptor to be checked */
 	/* out: NUMA node-id where the storage device is installed. It can
-	 *      be -1, if md-raid0 stripes SSDs on multiple NUMA nodes. */
+	 *      be -1, if md-raid stripes SSDs on multiple NUMA nodes. */
 	int				numa_node_id;
 	/* out: non-zero, if source SSD device supports 64bit DMA; which
 	 *      means NUMA aware SSD2RAM DMA is also supported. */
@@ -99,15 +115,75 @@ typedef struct StromCmd__MemCopySsdToGpu
 	char __user	   *wb_buffer;	/* in: write-back buffer in user space;
 								 * consumed from the tail, and must be at least
 								 * chunk_sz * nr_chunks bytes. */
+	/* STROM_IOCTL__MEMCPY_SSD2GPU_V1 has no fields below */
+	uint64_t __user *dest_offsets; /* in/out: destination offset of each
+								 *     chunk from the @offset, or NULL.
+								 *     If given, chunks are put on the GPU
+								 *     memory, or @wb_buffer, at the offset
+								 *     instead of packing; so @wb_buffer must
+								 *     cover the largest offset + chunk_sz.
+								 *     The array is rearranged on return,
+								 *     like @chunk_ids. */
 } StromCmd__MemCopySsdToGpu;
 
-/* STROM_IOCTL__MEMCPY_WAIT */
+/*
+ * STROM_IOCTL__MEMCPY_WAIT
+ *
+ * ID of the DMA task is a small integer assigned for each file descriptor
+ * of /proc/nvme-strom, so it is valid only on the file descriptor where
+ * the DMA task was submitted.
+ */
+#define STROM_MEMCPY_WAIT__HYBRID_POLL	0x0001	/* spin for the mean latency
+												 * of the device prior to
+												 * sleep */
 typedef struct StromCmd__MemCopyWait
 {
 	unsigned long	dma_task_id;/* in: ID of the DMA task to wait */
 	long			status;		/* out: status of the DMA task */
+	/* STROM_IOCTL__MEMCPY_WAIT_V1 has no fields below */
+	unsigned int	flags;		/* in: STROM_MEMCPY_WAIT__* flags */
 } StromCmd__MemCopyWait;
 
+/* STROM_IOCTL__MEMCPY_WAIT_MULTI */
+#define STROM_MEMCPY_WAIT_MULTI_MAXSZ	1024
+typedef struct StromWaitEntry
+{
+	unsigned long	dma_task_id;/* in: ID of the DMA task to wait */
+	long			status;		/* out: status of the DMA task */
+	int				done;		/* out: non-zero, if DMA task is completed */
+} StromWaitEntry;
+
+typedef struct StromCmd__MemCopyWaitMulti
+{
+	unsigned int	nr_tasks;	/* in: number of DMA tasks; up to
+								 *     STROM_MEMCPY_WAIT_MULTI_MAXSZ */
+	unsigned int	wait_all;	/* in: non-zero to wait for all the tasks;
+								 *     elsewhere, it returns once any of
+								 *     the tasks get completed. */
+	unsigned int	nr_done;	/* out: number of completed DMA tasks */
+	StromWaitEntry __user *tasks; /* in/out: array of DMA tasks; all of them
+								 *     must be submitted on the same file
+								 *     descriptor. */
+	unsigned int	flags;		/* in: STROM_MEMCPY_WAIT__* flags */
+} StromCmd__MemCopyWaitMulti;
+
+/*
+ * STROM_IOCTL__MEMCPY_CANCEL
+ *
+ * It reclaims the DMA task without blocking. It does not stop the commands
+ * in-flight; all of them are already submitted when MEMCPY_SSD2GPU or
+ * MEMCPY_SSD2RAM returns. The task is released once they get completed,
+ * without error status nor completion ring entry, and the error status of
+ * the task already failed is reclaimed.
+ * The task holds a reference on the destination DMA buffer until the
+ * commands in-flight get completed, so the buffer can be unmapped right
+ * after the cancel, but its contents must not be reused for other DMA.
+ */
+typedef struct StromCmd__MemCopyCancel
+{
+	unsigned long	dma_task_id;/* in: ID of the DMA task to cancel */
+} StromCmd__MemCopyCancel;
+
 /* STROM_IOCTL__MEMCPY_SSD2RAM */
 typedef struct StromCmd__MemCopySsdToRam
 {
@@ -120,15 +196,155 @@ typedef struct StromCmd__MemCopySsdToRam
 	void __user	   *dest_uaddr;	/* in: virtual address of the destination
 								 *     buffer; which must be mapped using
 								 *     mmap(2) on /proc/nvme-strom */
-	int				file_desc;	/* in: file descriptor of the source file */
+	int				file_desc;	/* in: file descriptor of the source file,
+								 *     or NVMe-SSD / md-raid block device
+								 *     itself; then, file offset is the
+								 *     location on the device. */
 	unsigned int	nr_chunks;	/* in: number of chunks */
 	unsigned int    chunk_sz;	/* in: chunk-size (BLCKSZ in PostgreSQL) */
 	unsigned int	relseg_sz;	/* in: # of chunks per file. (RELSEG_SIZE
 								 *     in PostgreSQL). 0 means no boundary. */
 	uint32_t __user *chunk_ids;	/* in: # of chunks per file (RELSEG_SIZE in
 								 *     PostgreSQL). 0 means no boundary. */
+	/* STROM_IOCTL__MEMCPY_SSD2RAM_V1 has no fields below */
+	unsigned int	flags;		/* in: STROM_MEMCPY_SSD2RAM__* flags */
+	uint64_t __user *dest_offsets; /* in: destination offset of each chunk
+								 *     from the @dest_uaddr, or NULL to put
+								 *     the chunks in order. */
+	unsigned int	hybrid_ratio;	/* in: percentage of the cached pages to
+								 *     split the chunk, if HYBRID. 0 means
+								 *     the default (50). */
+	unsigned int	max_merge_gap_kb; /* in: max size of the gap [KB] to be
+								 *     read and discarded, to merge READ
+								 *     commands, if SORTED. 0 means the
+								 *     max_merge_gap_kb module parameter. */
 } StromCmd__MemCopySsdToRam;
 
+/* sort the chunks by the physical location, then merge and submit */
+#define STROM_MEMCPY_SSD2RAM__SORTED		0x0001
+/* source file is given for each range (MEMCPY_SSD2RAM_RANGES only) */
+#define STROM_MEMCPY_SSD2RAM__MULTI_FILES	0x0002
+/*
+ * partial-hybrid mode; if more than @hybrid_ratio percent of the pages in
+ * a chunk are cached (or any page is dirty), the cached pages are copied
+ * by CPU and the rest are read by DMA, instead of copying the whole chunk
+ * from the page cache with synchronous reads of the uncached pages.
+ */
+#define STROM_MEMCPY_SSD2RAM__HYBRID		0x0004
+
+/*
+ * STROM_IOCTL__MEMCPY_SSD2RAM_RANGES
+ *
+ * It is a variation of STROM_IOCTL__MEMCPY_SSD2RAM, but source is given by
+ * a list of byte ranges, instead of chunk_ids. All of @file_pos, @length
+ * and @dest_offset must be aligned to PAGE_SIZE, and the range must not
+ * go beyond the end of the source file (rounded up to PAGE_SIZE).
+ * Each range is processed by units of 2MB aligned to the file offset; so
+ * nr_ram2ram and nr_ssd2ram count the units, not the ranges.
+ * If STROM_MEMCPY_SSD2RAM__MULTI_FILES is given, each range has its own
+ * source file by @file_desc, up to STROM_MEMCPY_RANGES_MAXFILES distinct
+ * files, on the same or different NVMe-SSD devices. All of them are read
+ * by one DMA task, so a single wait covers the entire command.
+ * If STROM_MEMCPY_SSD2RAM__SORTED is given, the destination of the ranges
+ * must not overlap each other; elsewhere, it returns EINVAL.
+ */
+#define STROM_MEMCPY_RANGES_MAXSZ		65536
+#define STROM_MEMCPY_RANGES_MAXFILES	256
+typedef struct StromMemCopyRange
+{
+	uint64_t		file_pos;	/* in: offset of the source file */
+	uint64_t		length;		/* in: length of the range */
+	uint64_t		dest_offset;/* in: offset from the @dest_uaddr */
+	int				file_desc;	/* in: file descriptor of the source file,
+								 *     if STROM_MEMCPY_SSD2RAM__MULTI_FILES.
+								 *     Elsewhere, it is ignored. */
+} StromMemCopyRange;
+
+typedef struct StromCmd__MemCopySsdToRamRanges
+{
+	unsigned long	dma_task_id;/* out: ID of the DMA task */
+	unsigned int	nr_ram2ram; /* out: # of RAM2RAM units */
+	unsigned int	nr_ssd2ram; /* out: # of SSD2RAM units */
+	unsigned int	nr_dma_submit;	/* out: # of SSD2RAM DMA submit */
+	unsigned int	nr_dma_blocks;	/* out: # of SSD2RAM DMA blocks */
+
+	void __user	   *dest_uaddr;	/* in: virtual address of the destination
+								 *     buffer; which must be mapped using
+								 *     mmap(2) on /proc/nvme-strom */
+	int				file_desc;	/* in: file descriptor of the source file,
+								 *     or NVMe-SSD / md-raid block device.
+								 *     Ignored, if MULTI_FILES. */
+	unsigned int	nr_ranges;	/* in: number of ranges; up to
+								 *     STROM_MEMCPY_RANGES_MAXSZ */
+	StromMemCopyRange __user *ranges; /* in: array of the source ranges */
+	unsigned int	flags;		/* in: STROM_MEMCPY_SSD2RAM__* flags */
+	unsigned int	hybrid_ratio;	/* in: same as MEMCPY_SSD2RAM */
+	unsigned int	max_merge_gap_kb; /* in: same as MEMCPY_SSD2RAM */
+} StromCmd__MemCopySsdToRamRanges;
+
+/* STROM_IOCTL__MEMCPY_BATCH */
+#define STROM_MEMCPY_BATCH_MAXSZ		1024
+typedef struct StromCmd__MemCopyBatch
+{
+	unsigned int	nr_done;	/* out: # of commands successfully submitted */
+	unsigned int	command;	/* in: either of STROM_IOCTL__MEMCPY_SSD2GPU or
+								 *     STROM_IOCTL__MEMCPY_SSD2RAM; _V1
+								 *     numbers are not accepted */
+	unsigned int	nr_cmds;	/* in: number of commands; up to
+								 *     STROM_MEMCPY_BATCH_MAXSZ */
+	void __user	   *cmds;		/* in/out: array of StromCmd__MemCopySsdToGpu
+								 *     or StromCmd__MemCopySsdToRam according
+								 *     to the @command. 'out' fields of each
+								 *     entry are written back individually. */
+} StromCmd__MemCopyBatch;
+
+/* STROM_IOCTL__SETUP_COMPLETION_RING */
+typedef struct StromCmd__SetupCompletionRing
+{
+	unsigned int	nr_entries;	/* in: number of ring entries; must be
+								 *     power of 2 */
+	size_t			mmap_length;/* out: length of the completion ring to
+								 *      be mapped by mmap(2) on the file
+								 *      descriptor of /proc/nvme-strom */
+} StromCmd__SetupCompletionRing;
+
+/*
+ * Completion ring mapped on /proc/nvme-strom
+ *
+ * Once a completion ring is set up on a file descriptor, completion of the
+ * DMA tasks submitted via the file descriptor are posted to the ring.
+ * Kernel advances @tail, and application consumes the entries from @head
+ * to @tail, then advances @head. If ring is full, completion is not posted
+ * and @nr_overflow is incremented; application has to wait for the pending
+ * tasks by STROM_IOCTL__MEMCPY_WAIT in this case.
+ * poll(2) on the file descriptor reports POLLIN while the ring has entries
+ * to be consumed.
+ */
+typedef struct StromCompletionEntry
+{
+	unsigned long	dma_task_id;	/* ID of the completed DMA task */
+	long			status;			/* status of the DMA task */
+	unsigned int	nr_dma_submit;	/* # of DMA submit */
+	unsigned int	nr_dma_blocks;	/* # of DMA blocks */
+} StromCompletionEntry;
+
+typedef struct StromCompletionRing
+{
+	volatile uint32_t head;		/* index to consume; updated by application */
+	volatile uint32_t tail;		/* index to post; updated by kernel */
+	uint32_t		mask;		/* nr_entries - 1 */
+	volatile uint32_t nr_overflow;	/* # of completions not posted */
+	StromCompletionEntry entries[1];
+} StromCompletionRing;
+
+/* STROM_IOCTL__SETUP_EVENTFD */
+typedef struct StromCmd__SetupEventFd
+{
+	int				eventfd;	/* in: eventfd(2) to be signaled on completion
+								 *     of the DMA tasks submitted on the file
+								 *     descriptor, or -1 to detach */
+} StromCmd__SetupEventFd;
+
 /* STROM_IOCTL__ALLOC_DMA_BUFFER */
 typedef struct StromCmd__AllocDMABuffer
 {
@@ -137,10 +353,15 @@ typedef struct StromCmd__AllocDMABuffer
 	int				dmabuf_fdesc; /* out: FD of anon file descriptor */
 } StromCmd__AllocDMABuffer;
 
-/* STROM_IOCTL__STAT_INFO */
+/*
+ * STROM_IOCTL__STAT_INFO
+ *
+ * Version 1 has the fields up to @clk_debug4, and version 2 has all the
+ * fields. Only the fields of the given version are read and written.
+ */
 typedef struct StromCmd__StatInfo
 {
-	unsigned int	version;	/* in: = 1, always */
+	unsigned int	version;	/* in: = 2, or 1 */
 	unsigned char	has_debug;	/* out: true, if debug fields are valid */
 	uint64_t		tsc;		/* tsc counter */
 	uint64_t		nr_ssd2gpu;
@@ -162,6 +383,58 @@ typedef struct StromCmd__StatInfo
 	uint64_t		clk_debug3;
 	uint64_t		nr_debug4;
 	uint64_t		clk_debug4;
+	/* version 2 or later */
+	uint64_t		nr_dtask_alloc_hit;	/* DMA task from the recycled */
+	uint64_t		nr_dtask_alloc_miss;/* DMA task from the kmem_cache */
+	uint64_t		nr_cmd_cxt_alloc_hit;	/* command context from the
+											 * recycled */
+	uint64_t		nr_cmd_cxt_alloc_miss;	/* command context from the
+											 * kmem_cache */
+	uint64_t		nr_numa_submit_local;	/* submitted on the node of
+											 * the destination buffer */
+	uint64_t		nr_numa_submit_steered;	/* submission moved to the
+											 * node of the destination */
+	uint64_t		nr_numa_complete_local;	/* completed on the node of
+											 * the destination buffer */
+	uint64_t		nr_numa_complete_remote;/* completed on the other
+											 * node */
+	uint64_t		nr_extent_cache_hit;	/* block mapping from the
+											 * extent cache */
+	uint64_t		nr_extent_cache_miss;	/* block mapping from the
+											 * filesystem */
+	uint64_t		nr_gap_merge;	/* READ commands merged across gaps */
+	uint64_t		bytes_gap_waste;/* bytes of the gaps being read */
+	uint64_t		nr_zero_fill;	/* pages of holes filled up by CPU */
+	uint64_t		nr_hybrid_copy;	/* cached pages copied by CPU in the
+									 * partial-hybrid mode */
 } StromCmd__StatInfo;
 
+/* STROM_IOCTL__STAT_DEVICES */
+#define STROM_DEVICE_NAME_LEN		32
+
+typedef struct StromDeviceStat
+{
+	char			disk_name[STROM_DEVICE_NAME_LEN];	/* NVMe namespace */
+	char			volume_name[STROM_DEVICE_NAME_LEN];	/* md/dm volume of
+										 * the last command, or empty if
+										 * it was raw NVMe-SSD */
+	uint64_t		nr_cmds;		/* READ commands completed */
+	uint64_t		nr_errors;		/* READ commands completed with error */
+	uint64_t		bytes_read;		/* bytes read by the commands */
+	uint64_t		clk_cmds;		/* total latency in TSC clocks */
+	uint64_t		clk_ewma;		/* moving average of the latency */
+	uint32_t		cur_inflight;	/* READ commands in-flight */
+	uint32_t		max_inflight;	/* max of in-flight since the last
+									 * call that returned all the entries */
+} StromDeviceStat;
+
+typedef struct StromCmd__StatDevices
+{
+	unsigned int	version;	/* in: = 1, always */
+	uint32_t		nrooms;		/* in: length of the @devices array */
+	uint32_t		nitems;		/* out: number of NVMe devices */
+	uint64_t		tsc;		/* out: tsc counter */
+	StromDeviceStat	devices[1];	/* out: statistics of each device */
+} StromCmd__StatDevices;
+
 #endif /* NVME_STROM_H */
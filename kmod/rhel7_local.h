@@ -3,6 +3,7 @@
 #include "514.6.2.el7/nvme.h"
 #include "514.6.2.el7/md.h"
 #include "514.6.2.el7/raid0.h"
+#include "514.6.2.el7/dm.h"
 #else	/* KERNEL_RELEASE_NUM */
 #error Not a supported kernel release - update the kernel package!
 #endif	/* KERNEL_RELEASE_NUM */
@@ -55,6 +55,7 @@ static bool					nvmestrom_enabled;			/* GUC */
 static int					nvmestrom_chunk_size_kb;	/* GUC */
 static int					nvmestrom_buffer_size_kb;	/* GUC */
 static double				nvmestrom_seq_page_cost;	/* GUC */
+static bool					nvmestrom_hybrid_polling;	/* GUC */
 static bool					nvmestrom_debug_no_threshold; /* GUC */
 static long					sysconf_pagesize;	/* _SC_PAGESIZE */
 static long					sysconf_phys_pages;	/* _SC_PHYS_PAGES */
@@ -70,6 +71,7 @@ static int					nvme_last_numa_node_id;
 typedef struct NVMEStromDMAChunk
 {
 	unsigned long	dma_task_id;/* handler of DMA task */
+	bool			in_use;		/* true, if chunk is loaded or in loading */
 	BlockNumber		block_pos;	/* block number begin to read */
 	unsigned int	num_blocks;	/* number of blocks to read */
 	char		   *chunk_buf;	/* mapped DMA buffer */
@@ -130,10 +132,14 @@ typedef struct NVMEStromState {
 
 	/* state of asynchronous scan with DMA */
 	bool		scan_done;		/* true, if already end of relation */
-	int			dma_rindex;		/* index to read next */
-	int			dma_windex;		/* index to write next */
 	int			free_chunks;	/* number of available chunks */
 	Buffer		vm_buffer;		/* buffer for visibility map */
+	/* argument buffer for STROM_IOCTL__MEMCPY_BATCH */
+	StromCmd__MemCopySsdToRam *batch_cmds;
+	NVMEStromDMAChunk **batch_chunks;
+	/* argument buffer for STROM_IOCTL__MEMCPY_WAIT_MULTI */
+	StromWaitEntry *wait_tasks;
+	NVMEStromDMAChunk **wait_chunks;
 	NVMEStromDMAChunk dma_chunks[FLEXIBLE_ARRAY_MEMBER];
 } NVMEStromState;
 
@@ -620,8 +626,6 @@ ExecInitNVMEStrom(CustomScanState *node,
 	nss->curr_bindex = 0;
 	nss->curr_lineoff = FirstOffsetNumber;
 
-	nss->dma_rindex = 0;
-	nss->dma_windex = 0;
 	nss->free_chunks = nss->num_chunks;
 	nss->vm_buffer = InvalidBuffer;
 
@@ -827,6 +831,14 @@ ExecInitNVMEStromLater(NVMEStromState *nss)
 			dchunk->chunk_ids = palloc0(sizeof(uint32_t) *
 										(nss->chunk_sz / BLCKSZ));
 		}
+		nss->batch_cmds = palloc0(sizeof(StromCmd__MemCopySsdToRam) *
+								  nss->num_chunks);
+		nss->batch_chunks = palloc0(sizeof(NVMEStromDMAChunk *) *
+									nss->num_chunks);
+		nss->wait_tasks = palloc0(sizeof(StromWaitEntry) *
+								  nss->num_chunks);
+		nss->wait_chunks = palloc0(sizeof(NVMEStromDMAChunk *) *
+								   nss->num_chunks);
 	}
 	PG_CATCH();
 	{
@@ -848,10 +860,15 @@ ExecInitNVMEStromLater(NVMEStromState *nss)
 
 /*
  * nvmestrom_load_chunk
+ *
+ * It copies cached or not all-visible blocks synchronously, then sets up
+ * @cmd to load the rest of blocks by SSD2RAM DMA. It returns false, if no
+ * DMA request is needed for this chunk.
  */
-static void
+static bool
 nvmestrom_load_chunk(NVMEStromState *nss,
-					 NVMEStromDMAChunk *dchunk)
+					 NVMEStromDMAChunk *dchunk,
+					 StromCmd__MemCopySsdToRam *cmd)
 {
 	Relation		relation = nss->css.ss.ss_currentRelation;
 	SMgrRelation	smgr = relation->rd_smgr;
@@ -941,35 +958,138 @@ nvmestrom_load_chunk(NVMEStromState *nss,
 	}
 	Assert(num_blocks == j + k);
 
+	/* dma_task_id is set by nvmestrom_submit_chunks, if DMA is needed */
+	dchunk->dma_task_id = ~0UL;
 	if (j == 0)
+		return false;
+
+	memset(cmd, 0, sizeof(StromCmd__MemCopySsdToRam));
+	cmd->dest_uaddr = dchunk->chunk_buf;
+	cmd->file_desc = FileGetRawDesc(nss->mdfd[dchunk->block_pos / RELSEG_SIZE]);
+	cmd->nr_chunks = j;
+	cmd->chunk_sz = BLCKSZ;
+	cmd->relseg_sz = RELSEG_SIZE;
+	cmd->chunk_ids = dchunk->chunk_ids;
+
+	return true;
+}
+
+/*
+ * nvmestrom_submit_chunks
+ *
+ * It kicks SSD2RAM DMA for all the chunks loaded by nvmestrom_load_chunk()
+ * with one STROM_IOCTL__MEMCPY_BATCH call.
+ */
+static void
+nvmestrom_submit_chunks(NVMEStromState *nss, int nr_cmds)
+{
+	StromCmd__MemCopyBatch cmd;
+	int		i;
+
+	if (nr_cmds == 0)
+		return;
+
+	memset(&cmd, 0, sizeof(StromCmd__MemCopyBatch));
+	cmd.command = STROM_IOCTL__MEMCPY_SSD2RAM;
+	cmd.nr_cmds = nr_cmds;
+	cmd.cmds = nss->batch_cmds;
+	if (nvme_strom_ioctl(STROM_IOCTL__MEMCPY_BATCH, &cmd) != 0)
 	{
-		/* no need to issue DMA requests */
-		dchunk->dma_task_id = ~0UL;
+		/* track the submitted DMA tasks; they are still running */
+		for (i=0; i < cmd.nr_done; i++)
+			nss->batch_chunks[i]->dma_task_id = nss->batch_cmds[i].dma_task_id;
+		elog(ERROR, "failed on ioctl(STROM_IOCTL__MEMCPY_BATCH) : %m");
 	}
-	else
+
+	for (i=0; i < nr_cmds; i++)
 	{
-		StromCmd__MemCopySsdToRam cmd;
-		File	vfd = nss->mdfd[dchunk->block_pos / RELSEG_SIZE];
-
-		memset(&cmd, 0, offsetof(StromCmd__MemCopySsdToRam, dest_uaddr));
-		cmd.dest_uaddr = dchunk->chunk_buf;
-		cmd.file_desc = FileGetRawDesc(vfd);
-		cmd.nr_chunks = j;
-		cmd.chunk_sz = BLCKSZ;
-		cmd.relseg_sz = RELSEG_SIZE;
-		cmd.chunk_ids = dchunk->chunk_ids;
-		if (nvme_strom_ioctl(STROM_IOCTL__MEMCPY_SSD2RAM, &cmd))
-			elog(ERROR, "failed on ioctl(STROM_IOCTL__MEMCPY_SSD2RAM) : %m");
-		dchunk->dma_task_id = cmd.dma_task_id;
+		StromCmd__MemCopySsdToRam *__cmd = &nss->batch_cmds[i];
+
+		nss->batch_chunks[i]->dma_task_id = __cmd->dma_task_id;
 #if PG_VERSION_NUM >= 100000
-		pg_atomic_fetch_add_u64(&nsp_desc->nr_ram2ram, cmd.nr_ram2ram);
-		pg_atomic_fetch_add_u64(&nsp_desc->nr_ssd2ram, cmd.nr_ssd2ram);
-		pg_atomic_fetch_add_u64(&nsp_desc->nr_dma_submit, cmd.nr_dma_submit);
-		pg_atomic_fetch_add_u64(&nsp_desc->nr_dma_blocks, cmd.nr_dma_blocks);
+		pg_atomic_fetch_add_u64(&nss->nsp_desc->nr_ram2ram,
+								__cmd->nr_ram2ram);
+		pg_atomic_fetch_add_u64(&nss->nsp_desc->nr_ssd2ram,
+								__cmd->nr_ssd2ram);
+		pg_atomic_fetch_add_u64(&nss->nsp_desc->nr_dma_submit,
+								__cmd->nr_dma_submit);
+		pg_atomic_fetch_add_u64(&nss->nsp_desc->nr_dma_blocks,
+								__cmd->nr_dma_blocks);
 #endif
 	}
 }
 
+/*
+ * nvmestrom_wait_chunks
+ *
+ * It waits for completion of any of the DMA tasks in progress, using
+ * STROM_IOCTL__MEMCPY_WAIT_MULTI. So, a slow DMA request does not block
+ * the chunks already loaded.
+ */
+static void
+nvmestrom_wait_chunks(NVMEStromState *nss, int nr_tasks)
+{
+	StromCmd__MemCopyWaitMulti cmd;
+	int		i, rc;
+
+	Assert(nr_tasks > 0);
+	memset(&cmd, 0, sizeof(StromCmd__MemCopyWaitMulti));
+	cmd.nr_tasks = nr_tasks;
+	cmd.wait_all = 0;
+	if (nvmestrom_hybrid_polling)
+		cmd.flags |= STROM_MEMCPY_WAIT__HYBRID_POLL;
+	cmd.tasks = nss->wait_tasks;
+	rc = nvme_strom_ioctl(STROM_IOCTL__MEMCPY_WAIT_MULTI, &cmd);
+
+	/* completed tasks are no longer tracked, even if error */
+	for (i=0; i < nr_tasks; i++)
+	{
+		if (nss->wait_tasks[i].done)
+			nss->wait_chunks[i]->dma_task_id = ~0UL;
+	}
+	for (i=0; i < nr_tasks; i++)
+	{
+		if (nss->wait_tasks[i].done && nss->wait_tasks[i].status != 0)
+			elog(ERROR, "DMA task (id=%lu) failed (status=%ld)",
+				 nss->wait_tasks[i].dma_task_id,
+				 nss->wait_tasks[i].status);
+	}
+	if (rc != 0)
+	{
+		if (errno == EINTR)
+			CHECK_FOR_INTERRUPTS();
+		else
+			elog(ERROR, "failed on ioctl(STROM_IOCTL__MEMCPY_WAIT_MULTI) : %m");
+	}
+}
+
+/*
+ * nvmestrom_cancel_chunks
+ *
+ * It cancels the DMA tasks in progress, when scan is abandoned (e.g, LIMIT
+ * clause), not to wait for the unused chunks. The DMA buffer is kept by
+ * the tasks until completion of the commands in-flight.
+ */
+static void
+nvmestrom_cancel_chunks(NVMEStromState *nss)
+{
+	StromCmd__MemCopyCancel cmd;
+	int		i;
+
+	for (i=0; i < nss->num_chunks; i++)
+	{
+		NVMEStromDMAChunk *dchunk = &nss->dma_chunks[i];
+
+		if (!dchunk->in_use || dchunk->dma_task_id == ~0UL)
+			continue;
+		memset(&cmd, 0, sizeof(StromCmd__MemCopyCancel));
+		cmd.dma_task_id = dchunk->dma_task_id;
+		if (nvme_strom_ioctl(STROM_IOCTL__MEMCPY_CANCEL, &cmd) != 0)
+			elog(WARNING, "failed on ioctl(STROM_IOCTL__MEMCPY_CANCEL) : %m");
+		dchunk->dma_task_id = ~0UL;
+	}
+}
+
 /*
  * nvmestrom_next_chunk
  */
@@ -980,18 +1100,25 @@ nvmestrom_next_chunk(NVMEStromState *nss)
 	NVMEStromDMAChunk *dchunk;
 	BlockNumber		block_pos;
 	unsigned int	num_blocks = nss->chunk_sz / BLCKSZ;
+	int				nr_cmds = 0;
+	int				nr_tasks;
+	int				i;
 
 	/* release the last chunk which is already read */
 	if (nss->curr_dchunk)
 	{
+		nss->curr_dchunk->in_use = false;
 		nss->curr_dchunk = NULL;
 		nss->free_chunks++;
 	}
 
 	/* enqueue request until fill of dma chunks */
-	while (!nss->scan_done && nss->free_chunks > 0)
+	for (i=0; !nss->scan_done && nss->free_chunks > 0; i++)
 	{
-		dchunk = &nss->dma_chunks[nss->dma_windex % nss->num_chunks];
+		Assert(i < nss->num_chunks);
+		dchunk = &nss->dma_chunks[i];
+		if (dchunk->in_use)
+			continue;
 
 		/* Identify the next range of blocks to read */
 		block_pos = pg_atomic_fetch_add_u64(&nsp_desc->nsp_cblock,
@@ -1013,33 +1140,47 @@ nvmestrom_next_chunk(NVMEStromState *nss)
 		/* load a chunk with sync or async manner */
 		dchunk->block_pos = block_pos;
 		dchunk->num_blocks = num_blocks;
-		nvmestrom_load_chunk(nss, dchunk);
+		if (nvmestrom_load_chunk(nss, dchunk, &nss->batch_cmds[nr_cmds]))
+			nss->batch_chunks[nr_cmds++] = dchunk;
 		/* Increment chunk usage */
-		nss->dma_windex++;
+		dchunk->in_use = true;
 		nss->free_chunks--;
 	}
+	/* kick DMA for the chunks above at once */
+	nvmestrom_submit_chunks(nss, nr_cmds);
 
 	/* OK, we have no chunks to be returned any more */
-	if (nss->dma_windex == nss->dma_rindex)
+	if (nss->free_chunks == nss->num_chunks)
 	{
 		Assert(nss->scan_done);
-		Assert(nss->free_chunks == nss->num_chunks);
 		return false;
 	}
 
-	/* Wait for the next available chunk */
-	dchunk = &nss->dma_chunks[nss->dma_rindex++ % nss->num_chunks];
-	while (dchunk->dma_task_id != ~0UL)
+	/*
+	 * Pick up a chunk already loaded, regardless of the order of
+	 * submission. If none, wait for completion of any DMA task.
+	 */
+	for (;;)
 	{
-		StromCmd__MemCopyWait cmd;
-
-		cmd.dma_task_id = dchunk->dma_task_id;
-		if (nvme_strom_ioctl(STROM_IOCTL__MEMCPY_WAIT, &cmd) == 0)
-			dchunk->dma_task_id = ~0UL;
-		else if (errno == EINTR)
-			CHECK_FOR_INTERRUPTS();
-		else
-			elog(ERROR, "failed on ioctl(STROM_IOCTL__MEMCPY_WAIT) : %m");
+		dchunk = NULL;
+		nr_tasks = 0;
+		for (i=0; i < nss->num_chunks; i++)
+		{
+			if (!nss->dma_chunks[i].in_use)
+				continue;
+			if (nss->dma_chunks[i].dma_task_id == ~0UL)
+			{
+				dchunk = &nss->dma_chunks[i];
+				break;
+			}
+			nss->wait_tasks[nr_tasks].dma_task_id
+				= nss->dma_chunks[i].dma_task_id;
+			nss->wait_chunks[nr_tasks] = &nss->dma_chunks[i];
+			nr_tasks++;
+		}
+		if (dchunk)
+			break;
+		nvmestrom_wait_chunks(nss, nr_tasks);
 	}
 	nss->curr_dchunk = dchunk;
 	nss->curr_bindex = 0;
@@ -1155,6 +1296,8 @@ ExecEndNVMEStrom(CustomScanState *node)
 		UnregisterSnapshot(nss->worker_snapshot);
 	if (nss->mmap_dma_buf)
 	{
+		/* DMA tasks in progress are no longer needed */
+		nvmestrom_cancel_chunks(nss);
 		NVMEStromForgetDMABuffer(nss->mmap_dma_buf);
 		nss->mmap_dma_buf = NULL;
 	}
@@ -1300,6 +1443,15 @@ _PG_init(void)
 							NULL, NULL, NULL);
 	//TODO: nvme_strom.buffer_size_limit ... default: 2GB
 
+	/* nvme_strom.hybrid_polling */
+	DefineCustomBoolVariable("nvme_strom.hybrid_polling",
+							 "spins for the mean latency of SSD prior to sleep on the wait for DMA",
+							 NULL,
+							 &nvmestrom_hybrid_polling,
+							 false,
+							 PGC_USERSET,
+							 GUC_NOT_IN_SAMPLE,
+							 NULL, NULL, NULL);
 	/* nvme_strom.seq_page_cost */
 	DefineCustomRealVariable("nvme_strom.seq_page_cost",
 							 "Sets the planner's estimate of the cost of "
@@ -10,6 +10,7 @@
  * it under the terms of the GNU General Public License version 2,
  * as published by the Free Software Foundation.
  */
+#include <errno.h>
 #include <fcntl.h>
 #include <libgen.h>
 #include <stdint.h>
@@ -101,29 +102,235 @@ print_stat(int loop, StromCmd__StatInfo *p, StromCmd__StatInfo *c,
 	putchar('\n');
 }
 
+/*
+ * fetch_stat_devices - fetch statistics of each NVMe device; the buffer is
+ * expanded if more devices than the last call.
+ */
+static StromCmd__StatDevices *
+fetch_stat_devices(uint32_t nrooms)
+{
+	StromCmd__StatDevices *cmd;
+
+	for (;;)
+	{
+		cmd = calloc(1, offsetof(StromCmd__StatDevices, devices[nrooms]));
+		if (!cmd)
+			ELOG(errno, "out of memory");
+		cmd->version = 1;
+		cmd->nrooms = nrooms;
+		if (nvme_strom_ioctl(STROM_IOCTL__STAT_DEVICES, cmd) == 0)
+			return cmd;
+		if (errno != ENOBUFS)
+			ELOG(errno, "failed on ioctl(STROM_IOCTL__STAT_DEVICES)");
+		nrooms = cmd->nitems + 8;
+		free(cmd);
+	}
+}
+
+static StromDeviceStat *
+lookup_stat_device(StromCmd__StatDevices *s, const char *disk_name)
+{
+	uint32_t	i;
+
+	if (!s)
+		return NULL;
+	for (i=0; i < s->nitems; i++)
+	{
+		if (strcmp(s->devices[i].disk_name, disk_name) == 0)
+			return &s->devices[i];
+	}
+	return NULL;
+}
+
+static void
+print_stat_device_line(const char *disk_name, const char *volume_name,
+					   uint64_t nr_cmds, uint64_t nr_errors,
+					   uint64_t bytes_read, uint64_t clk_cmds,
+					   uint64_t cur_inflight, uint64_t max_inflight,
+					   double interval, double clocks_per_sec)
+{
+	printf("%-12s %-10s %9.1f %9.0f",
+		   disk_name,
+		   volume_name[0] ? volume_name : "-",
+		   (double)bytes_read / (interval * 1048576.0),
+		   (double)nr_cmds / interval);
+	print_mean(nr_cmds, clk_cmds, clocks_per_sec);
+	printf(" %8lu %8lu %8lu\n",
+		   (unsigned long)cur_inflight,
+		   (unsigned long)max_inflight,
+		   (unsigned long)nr_errors);
+}
+
+/*
+ * print_stat_devices - statistics of each NVMe device in the interval, and
+ * the sum of members for each md/dm volume. A member with larger latency
+ * or deeper queue than the others is the bottleneck of the striped volume.
+ */
+static void
+print_stat_devices(StromCmd__StatDevices *p, StromCmd__StatDevices *c,
+				   struct timeval *tv1, struct timeval *tv2)
+{
+	double		interval;
+	double		clocks_per_sec;
+	uint32_t	i, j;
+
+	interval = ((double)((tv2->tv_sec - tv1->tv_sec) * 1000000 +
+						 (tv2->tv_usec - tv1->tv_usec))) / 1000000.0;
+	clocks_per_sec = (double)(c->tsc - p->tsc) / interval;
+
+	printf("device       volume          MB/s      IOPS    avg-lat"
+		   " inflight max-infl   errors\n");
+	for (i=0; i < c->nitems; i++)
+	{
+		StromDeviceStat *cd = &c->devices[i];
+		StromDeviceStat *pd = lookup_stat_device(p, cd->disk_name);
+		StromDeviceStat	zero;
+
+		if (!pd)
+		{
+			memset(&zero, 0, sizeof(StromDeviceStat));
+			pd = &zero;
+		}
+		print_stat_device_line(cd->disk_name,
+							   cd->volume_name,
+							   cd->nr_cmds - pd->nr_cmds,
+							   cd->nr_errors - pd->nr_errors,
+							   cd->bytes_read - pd->bytes_read,
+							   cd->clk_cmds - pd->clk_cmds,
+							   cd->cur_inflight,
+							   cd->max_inflight,
+							   interval, clocks_per_sec);
+	}
+
+	/* sum of the members for each volume */
+	for (i=0; i < c->nitems; i++)
+	{
+		const char *volume_name = c->devices[i].volume_name;
+		uint64_t	nr_cmds = 0;
+		uint64_t	nr_errors = 0;
+		uint64_t	bytes_read = 0;
+		uint64_t	clk_cmds = 0;
+		uint64_t	cur_inflight = 0;
+		uint64_t	max_inflight = 0;
+
+		if (volume_name[0] == '\0')
+			continue;
+		for (j=0; j < i; j++)
+		{
+			if (strcmp(c->devices[j].volume_name, volume_name) == 0)
+				break;
+		}
+		if (j < i)
+			continue;	/* already printed */
+
+		for (j=i; j < c->nitems; j++)
+		{
+			StromDeviceStat *cd = &c->devices[j];
+			StromDeviceStat *pd;
+
+			if (strcmp(cd->volume_name, volume_name) != 0)
+				continue;
+			pd = lookup_stat_device(p, cd->disk_name);
+			nr_cmds		+= cd->nr_cmds - (pd ? pd->nr_cmds : 0);
+			nr_errors	+= cd->nr_errors - (pd ? pd->nr_errors : 0);
+			bytes_read	+= cd->bytes_read - (pd ? pd->bytes_read : 0);
+			clk_cmds	+= cd->clk_cmds - (pd ? pd->clk_cmds : 0);
+			cur_inflight += cd->cur_inflight;
+			max_inflight += cd->max_inflight;
+		}
+		print_stat_device_line(volume_name, "(total)",
+							   nr_cmds, nr_errors, bytes_read, clk_cmds,
+							   cur_inflight, max_inflight,
+							   interval, clocks_per_sec);
+	}
+	putchar('\n');
+}
+
 static void
 usage(const char *command_name)
 {
 	fprintf(stderr,
-			"usage: %s [<interval>]\n",
+			"usage: %s [-d] [<interval>]\n"
+			"    -d : statistics of each NVMe device\n",
 			basename(strdup(command_name)));
 	exit(1);
 }
 
+/*
+ * main_stat_devices - main loop of the per-device statistics
+ */
+static int
+main_stat_devices(int interval)
+{
+	StromCmd__StatDevices *curr_stat;
+	StromCmd__StatDevices *prev_stat = NULL;
+	struct timeval		tv1, tv2;
+	uint32_t			i;
+
+	if (interval > 0)
+	{
+		for (;;)
+		{
+			curr_stat = fetch_stat_devices(prev_stat ? prev_stat->nitems : 32);
+			gettimeofday(&tv2, NULL);
+			if (prev_stat)
+			{
+				print_stat_devices(prev_stat, curr_stat, &tv1, &tv2);
+				free(prev_stat);
+			}
+			prev_stat = curr_stat;
+			tv1 = tv2;
+			sleep(interval);
+		}
+	}
+
+	curr_stat = fetch_stat_devices(32);
+	printf("tsc:             %lu\n", (unsigned long)curr_stat->tsc);
+	for (i=0; i < curr_stat->nitems; i++)
+	{
+		StromDeviceStat *dstat = &curr_stat->devices[i];
+
+		printf("[%s]\n"
+			   "volume_name:     %s\n"
+			   "nr_cmds:         %lu\n"
+			   "nr_errors:       %lu\n"
+			   "bytes_read:      %lu\n"
+			   "clk_cmds:        %lu\n"
+			   "clk_ewma:        %lu\n"
+			   "cur_inflight:    %u\n"
+			   "max_inflight:    %u\n",
+			   dstat->disk_name,
+			   dstat->volume_name,
+			   (unsigned long)dstat->nr_cmds,
+			   (unsigned long)dstat->nr_errors,
+			   (unsigned long)dstat->bytes_read,
+			   (unsigned long)dstat->clk_cmds,
+			   (unsigned long)dstat->clk_ewma,
+			   dstat->cur_inflight,
+			   dstat->max_inflight);
+	}
+	free(curr_stat);
+	return 0;
+}
+
 int
 main(int argc, char *argv[])
 {
 	int		loop;
 	int		interval;
 	int		c;
+	int		stat_devices = 0;
 	StromCmd__StatInfo	curr_stat;
 	StromCmd__StatInfo	prev_stat;
 	struct timeval		tv1, tv2;
 
-	while ((c = getopt(argc, argv, "h")) >= 0)
+	while ((c = getopt(argc, argv, "dh")) >= 0)
 	{
 		switch (c)
 		{
+			case 'd':
+				stat_devices = 1;
+				break;
 			case 'h':
 			default:
 				usage(argv[0]);
@@ -137,12 +344,15 @@ main(int argc, char *argv[])
 	else
 		usage(argv[0]);
 
+	if (stat_devices)
+		return main_stat_devices(interval);
+
 	if (interval > 0)
 	{
 		for (loop=-1; ; loop++)
 		{
 			memset(&curr_stat, 0, sizeof(StromCmd__StatInfo));
-			curr_stat.version = 1;
+			curr_stat.version = 2;
 			if (nvme_strom_ioctl(STROM_IOCTL__STAT_INFO, &curr_stat))
 				ELOG(errno, "failed on ioctl(STROM_IOCTL__STAT_INFO)");
 
@@ -157,7 +367,7 @@ main(int argc, char *argv[])
 	else
 	{
 		memset(&curr_stat, 0, sizeof(StromCmd__StatInfo));
-		curr_stat.version = 1;
+		curr_stat.version = 2;
 		if (nvme_strom_ioctl(STROM_IOCTL__STAT_INFO, &curr_stat))
 			ELOG(errno, "failed on ioctl(STROM_IOCTL__STAT_INFO)");
 
@@ -172,7 +382,21 @@ main(int argc, char *argv[])
 			   "clk_wait_dtask:  %lu\n"
 			   "nr_wrong_wakeup: %lu\n"
 			   "cur_dma_count:   %lu\n"
-			   "max_dma_count:   %lu\n",
+			   "max_dma_count:   %lu\n"
+			   "nr_dtask_alloc_hit:    %lu\n"
+			   "nr_dtask_alloc_miss:   %lu\n"
+			   "nr_cmd_cxt_alloc_hit:  %lu\n"
+			   "nr_cmd_cxt_alloc_miss: %lu\n"
+			   "nr_numa_submit_local:    %lu\n"
+			   "nr_numa_submit_steered:  %lu\n"
+			   "nr_numa_complete_local:  %lu\n"
+			   "nr_numa_complete_remote: %lu\n"
+			   "nr_extent_cache_hit:     %lu\n"
+			   "nr_extent_cache_miss:    %lu\n"
+			   "nr_gap_merge:            %lu\n"
+			   "bytes_gap_waste:         %lu\n"
+			   "nr_zero_fill:            %lu\n"
+			   "nr_hybrid_copy:          %lu\n",
 			   (unsigned long)curr_stat.tsc,
 			   (unsigned long)curr_stat.nr_ssd2gpu,
 			   (unsigned long)curr_stat.clk_ssd2gpu,
@@ -184,7 +408,21 @@ main(int argc, char *argv[])
 			   (unsigned long)curr_stat.clk_wait_dtask,
 			   (unsigned long)curr_stat.nr_wrong_wakeup,
 			   (unsigned long)curr_stat.cur_dma_count,
-			   (unsigned long)curr_stat.max_dma_count);
+			   (unsigned long)curr_stat.max_dma_count,
+			   (unsigned long)curr_stat.nr_dtask_alloc_hit,
+			   (unsigned long)curr_stat.nr_dtask_alloc_miss,
+			   (unsigned long)curr_stat.nr_cmd_cxt_alloc_hit,
+			   (unsigned long)curr_stat.nr_cmd_cxt_alloc_miss,
+			   (unsigned long)curr_stat.nr_numa_submit_local,
+			   (unsigned long)curr_stat.nr_numa_submit_steered,
+			   (unsigned long)curr_stat.nr_numa_complete_local,
+			   (unsigned long)curr_stat.nr_numa_complete_remote,
+			   (unsigned long)curr_stat.nr_extent_cache_hit,
+			   (unsigned long)curr_stat.nr_extent_cache_miss,
+			   (unsigned long)curr_stat.nr_gap_merge,
+			   (unsigned long)curr_stat.bytes_gap_waste,
+			   (unsigned long)curr_stat.nr_zero_fill,
+			   (unsigned long)curr_stat.nr_hybrid_copy);
 		if (curr_stat.has_debug)
 			printf("nr_debug1:       %lu\n"
 				   "clk_debug1:      %lu\n"
@@ -307,6 +307,7 @@ setup_async_tasks(int fdesc, unsigned long handle)
 		rc = cuMemAllocHost(&async_tasks[i].src_buffer, segment_sz);
 		cuda_exit_on_error(rc, "cuMemAllocHost");
 		uarg->wb_buffer = async_tasks[i].src_buffer;
+		uarg->dest_offsets = NULL;
 
 		rc = cuMemAllocHost(&async_tasks[i].dest_buffer, segment_sz);
         cuda_exit_on_error(rc, "cuMemAllocHost");
@@ -11,8 +11,11 @@
  */
 #define _GNU_SOURCE
 #include <ctype.h>
+#include <poll.h>
 #include <pthread.h>
 #include <stdio.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/time.h>
@@ -28,6 +31,12 @@ static size_t		source_fpos = 0;
 static int			numa_node_id = -1;
 static int			proc_node_id = -1;		/* process's NUMA-Id */
 static int			enable_checks = 0;
+static int			use_completion_ring = 0;
+static int			print_wakeup_stat = 0;
+static int			sort_by_location = 0;
+static int			use_byte_ranges = 0;
+static int			hybrid_ratio = -1;		/* -1 means no hybrid mode */
+static int			merge_gap_kb = 0;		/* 0 means module parameter */
 static int			num_processes = 0;		/* single process in default */
 static size_t		buffer_size = (32UL << 20);		/* 32MB in default */
 static long			total_memcpy_wait = 0;	/* in ms */
@@ -146,18 +155,109 @@ alloc_dma_buffer(int node_id)
 	return buffer;
 }
 
+/*
+ * setup_completion_ring - set up and map the completion ring
+ */
+static StromCompletionRing *
+setup_completion_ring(unsigned int nr_entries)
+{
+	StromCmd__SetupCompletionRing cmd;
+	void	   *cring;
+
+	memset(&cmd, 0, sizeof(StromCmd__SetupCompletionRing));
+	cmd.nr_entries = nr_entries;
+	if (nvme_strom_ioctl(STROM_IOCTL__SETUP_COMPLETION_RING, &cmd))
+		ELOG(errno, "failed on ioctl(STROM_IOCTL__SETUP_COMPLETION_RING)");
+
+	cring = mmap(NULL, cmd.mmap_length,
+				 PROT_READ | PROT_WRITE,
+				 MAP_SHARED,
+				 nvme_strom_fdesc(), 0);
+	if (cring == MAP_FAILED)
+		ELOG(errno, "failed on mmap(2) of the completion ring");
+	return cring;
+}
+
+/*
+ * wait_dma_task - wait for completion of the DMA task of the unit @index
+ *
+ * If completion ring is available, it consumes the ring entries, and
+ * marks the units completed. It sleeps by poll(2) while ring is empty.
+ * Once ring overflowed, some completions are never posted, so it falls
+ * back to MEMCPY_WAIT.
+ */
+static void
+wait_dma_task(StromCompletionRing *cring,
+			  unsigned long *dma_tasks, char *dma_done,
+			  long windex, long rindex, int n_units)
+{
+	StromCmd__MemCopyWait cmd;
+	int			index = windex % n_units;
+	long		i;
+
+	while (cring && !dma_done[index] && cring->nr_overflow == 0)
+	{
+		uint32_t	head = cring->head;
+		uint32_t	tail = cring->tail;
+
+		if (head == tail)
+		{
+			struct pollfd	pfd;
+
+			/* sleep until any completion is posted */
+			pfd.fd = nvme_strom_fdesc();
+			pfd.events = POLLIN;
+			pfd.revents = 0;
+			if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+				ELOG(errno, "failed on poll(2)");
+			continue;
+		}
+		__sync_synchronize();
+		while (head != tail)
+		{
+			StromCompletionEntry *centry = &cring->entries[head & cring->mask];
+
+			if (centry->status)
+				ELOG(EIO, "DMA task (id=%lu) failed (status=%ld)",
+					 centry->dma_task_id, centry->status);
+			for (i=windex; i < rindex; i++)
+			{
+				if (dma_tasks[i % n_units] == centry->dma_task_id)
+				{
+					dma_done[i % n_units] = 1;
+					break;
+				}
+			}
+			head++;
+		}
+		__sync_synchronize();
+		cring->head = head;
+	}
+
+	if (!dma_done[index])
+	{
+		memset(&cmd, 0, sizeof(cmd));
+		cmd.dma_task_id	= dma_tasks[index];
+		if (nvme_strom_ioctl(STROM_IOCTL__MEMCPY_WAIT, &cmd))
+			ELOG(errno, "failed on ioctl(STROM_IOCTL__MEMCPY_WAIT)");
+	}
+	dma_done[index] = 0;
+}
+
 static void *
 ssd2ram_worker(void *__args__)
 {
 	StromCmd__MemCopySsdToRam cmd;
+	StromCompletionRing *cring = NULL;
 	char	   *dma_buffer;
 	unsigned long *dma_tasks;
+	char	   *dma_done;
 	uint32_t   *chunk_ids;
 	size_t		unitsz = (1UL << 20);	/* 1MB unit size */
 	int			n_units = (buffer_size / unitsz);
-	int			rindex;		/* read index */
-	int			windex;		/* wait index */
-	int			i;
+	long		rindex = 0;	/* read index */
+	long		windex = 0;	/* wait index */
+	int			i, j;
 	long		memcpy_wait = 0;
 	long		nr_ram2ram = 0;
 	long		nr_ssd2ram = 0;
@@ -168,12 +268,24 @@ ssd2ram_worker(void *__args__)
 	dma_tasks = malloc(sizeof(unsigned long) * n_units);
 	if (!dma_tasks)
 		ELOG(errno, "out of memory");
+	dma_done = calloc(n_units, sizeof(char));
+	if (!dma_done)
+		ELOG(errno, "out of memory");
 	chunk_ids = malloc(sizeof(uint32_t) * (unitsz / BLCKSZ));
 	if (!chunk_ids)
 		ELOG(errno, "out of memory");
 
 	/* allocation of the DMA buffer */
 	dma_buffer = alloc_dma_buffer(proc_node_id);
+	/* completion ring, if required */
+	if (use_completion_ring)
+	{
+		unsigned int	nr_entries = 2;
+
+		while (nr_entries < n_units)
+			nr_entries *= 2;
+		cring = setup_completion_ring(nr_entries);
+	}
 
 	for (;;)
 	{
@@ -182,16 +294,11 @@ ssd2ram_worker(void *__args__)
 		if (fpos >= source_fstat.st_size)
 			break;
 		/* wait until DMA buffer getting available */
-		i = rindex++ % n_units;
-		if (i == windex)
+		if (rindex - windex >= n_units)
 		{
-			StromCmd__MemCopyWait	__cmd;
-
 			gettimeofday(&tv1, NULL);
-			memset(&__cmd, 0, sizeof(__cmd));
-			__cmd.dma_task_id	= dma_tasks[windex++ % n_units];
-			if (nvme_strom_ioctl(STROM_IOCTL__MEMCPY_WAIT, &__cmd))
-				ELOG(errno, "failed on ioctl(STROM_IOCTL__MEMCPY_WAIT)");
+			wait_dma_task(cring, dma_tasks, dma_done,
+						  windex++, rindex, n_units);
 			gettimeofday(&tv2, NULL);
 
 			memcpy_wait += ((tv2.tv_sec * 1000 + tv2.tv_usec / 1000) -
@@ -200,6 +307,45 @@ ssd2ram_worker(void *__args__)
 			 * TODO: data corruption check here
 			 */
 		}
+		i = rindex % n_units;
+
+		if (use_byte_ranges)
+		{
+			StromCmd__MemCopySsdToRamRanges rcmd;
+			StromMemCopyRange range;
+
+			/* setup MEMCPY_SSD2RAM_RANGES command */
+			memset(&rcmd, 0, sizeof(rcmd));
+			rcmd.dest_uaddr	= dma_buffer + i * unitsz;
+			rcmd.file_desc	= source_fdesc;
+			rcmd.nr_ranges	= 1;
+			rcmd.ranges		= &range;
+			rcmd.flags		= (sort_by_location ? STROM_MEMCPY_SSD2RAM__SORTED : 0);
+			if (hybrid_ratio >= 0)
+			{
+				rcmd.flags |= STROM_MEMCPY_SSD2RAM__HYBRID;
+				rcmd.hybrid_ratio = hybrid_ratio;
+			}
+			rcmd.max_merge_gap_kb = merge_gap_kb;
+			range.file_pos	= fpos;
+			if (fpos + unitsz <= source_fstat.st_size)
+				range.length = unitsz;
+			else
+				range.length = (source_fstat.st_size - fpos) & ~(BLCKSZ - 1);
+			range.dest_offset = 0;
+			range.file_desc	= source_fdesc;
+
+			if (nvme_strom_ioctl(STROM_IOCTL__MEMCPY_SSD2RAM_RANGES, &rcmd))
+				ELOG(errno, "failed on ioctl(STROM_IOCTL__MEMCPY_SSD2RAM_RANGES)");
+
+			dma_tasks[i]	= rcmd.dma_task_id;
+			rindex++;
+			nr_ram2ram		+= rcmd.nr_ram2ram;
+			nr_ssd2ram		+= rcmd.nr_ssd2ram;
+			nr_dma_submit	+= rcmd.nr_dma_submit;
+			nr_dma_blocks	+= rcmd.nr_dma_blocks;
+			continue;
+		}
 
 		/* setup MEMCPY_SSD2RAM command */
 		memset(&cmd, 0, sizeof(cmd));
@@ -212,19 +358,36 @@ ssd2ram_worker(void *__args__)
 		cmd.chunk_sz	= BLCKSZ;
 		cmd.relseg_sz	= 0;
 		cmd.chunk_ids	= chunk_ids;
+		cmd.flags		= (sort_by_location ? STROM_MEMCPY_SSD2RAM__SORTED : 0);
+		if (hybrid_ratio >= 0)
+		{
+			cmd.flags |= STROM_MEMCPY_SSD2RAM__HYBRID;
+			cmd.hybrid_ratio = hybrid_ratio;
+		}
+		cmd.max_merge_gap_kb = merge_gap_kb;
 
-		for (i=0; i < cmd.nr_chunks; i++)
-			cmd.chunk_ids[i] = fpos / BLCKSZ + i;
+		for (j=0; j < cmd.nr_chunks; j++)
+			cmd.chunk_ids[j] = fpos / BLCKSZ + j;
 
 		if (nvme_strom_ioctl(STROM_IOCTL__MEMCPY_SSD2RAM, &cmd))
 			ELOG(errno, "failed on ioctl(STROM_IOCTL__MEMCPY_SSD2RAM)");
 
 		dma_tasks[i]	= cmd.dma_task_id;
+		rindex++;
 		nr_ram2ram		+= cmd.nr_ram2ram;
 		nr_ssd2ram		+= cmd.nr_ssd2ram;
 		nr_dma_submit	+= cmd.nr_dma_submit;
 		nr_dma_blocks	+= cmd.nr_dma_blocks;
 	}
+	/* wait for completion of the remaining DMA tasks */
+	gettimeofday(&tv1, NULL);
+	while (windex < rindex)
+		wait_dma_task(cring, dma_tasks, dma_done,
+					  windex++, rindex, n_units);
+	gettimeofday(&tv2, NULL);
+	memcpy_wait += ((tv2.tv_sec * 1000 + tv2.tv_usec / 1000) -
+					(tv1.tv_sec * 1000 + tv1.tv_usec / 1000));
+
 	/* collect statistics */
 	__sync_fetch_and_add(&total_memcpy_wait, memcpy_wait);
 	__sync_fetch_and_add(&total_nr_ram2ram, nr_ram2ram);
@@ -235,6 +398,50 @@ ssd2ram_worker(void *__args__)
 	return NULL;
 }
 
+/*
+ * fetch_wakeup_stat - fetch the statistics of DMA task waits
+ */
+static void
+fetch_wakeup_stat(StromCmd__StatInfo *cmd)
+{
+	memset(cmd, 0, sizeof(StromCmd__StatInfo));
+	cmd->version = 2;
+	if (nvme_strom_ioctl(STROM_IOCTL__STAT_INFO, cmd))
+		ELOG(errno, "failed on ioctl(STROM_IOCTL__STAT_INFO)");
+}
+
+/*
+ * report_wakeup_stat - print the wake up statistics during the run; the
+ * scalability of the waits is the change of wrong wakeups per wait and
+ * latency of the wait, by the number of waiters (-n).
+ */
+static void
+report_wakeup_stat(StromCmd__StatInfo *p, StromCmd__StatInfo *c,
+				   long time_ms)
+{
+	uint64_t	nr_wait_dtask = c->nr_wait_dtask - p->nr_wait_dtask;
+	uint64_t	nr_wrong_wakeup = c->nr_wrong_wakeup - p->nr_wrong_wakeup;
+	uint64_t	clk_wait_dtask = c->clk_wait_dtask - p->clk_wait_dtask;
+	double		clk_per_usec = 0.0;
+
+	if (time_ms > 0)
+		clk_per_usec = (double)(c->tsc - p->tsc) / (1000.0 * (double)time_ms);
+	printf("waiters: %d, nr_wait_dtask: %lu, nr_wrong_wakeup: %lu",
+		   num_processes > 0 ? num_processes : 1,
+		   nr_wait_dtask,
+		   nr_wrong_wakeup);
+	if (nr_wait_dtask > 0)
+	{
+		printf(", wrong wakeup/wait: %.2f",
+			   (double)nr_wrong_wakeup / (double)nr_wait_dtask);
+		if (clk_per_usec > 0.0)
+			printf(", avg wait: %.1fus",
+				   (double)clk_wait_dtask /
+				   ((double)nr_wait_dtask * clk_per_usec));
+	}
+	putchar('\n');
+}
+
 static void
 print_results(long time_ms)
 {
@@ -286,10 +493,17 @@ static void
 usage(const char *argv0)
 {
 	fprintf(stderr,
-			"usage: %s [OPTIONS] <filename>\n"
+			"usage: %s [OPTIONS] <filename or block device>\n"
+			"  -b : use byte-range command instead of chunk ids\n"
 			"  -c : check SSD2RAM capability of the file\n"
+			"  -g <gap in KB> : max gap to merge READ commands, with -o\n"
+			"  -H <ratio> : partial-hybrid mode; copy cached pages by CPU if\n"
+			"               more than <ratio>%% of the chunk is cached\n"
 			"  -n <num worker threads>\n"
 			"  -p <numa node-id of process>\n"
+			"  -r : use completion ring instead of MEMCPY_WAIT\n"
+			"  -w : print wakeup statistics of the DMA task waits\n"
+			"  -o : sort chunks by the physical location prior to DMA\n"
 			"  -s <buffer size in MB>\n",
 			basename(strdup(argv0)));
 	exit(1);
@@ -299,24 +513,48 @@ int
 main(int argc, char *argv[])
 {
 	struct timeval	tv1, tv2;
+	StromCmd__StatInfo wakeup_stat[2];
+	long			time_ms;
 	int				c, i;
 
-	while ((c = getopt(argc, argv, "cn:p:s:h")) >= 0)
+	while ((c = getopt(argc, argv, "bcg:H:n:op:rs:wh")) >= 0)
 	{
 		switch (c)
 		{
+			case 'b':
+				use_byte_ranges = 1;
+				break;
 			case 'c':
 				enable_checks = 1;
 				break;
+			case 'g':
+				merge_gap_kb = atoi(optarg);
+				if (merge_gap_kb < 0)
+					usage(argv[0]);
+				break;
+			case 'H':
+				hybrid_ratio = atoi(optarg);
+				if (hybrid_ratio < 0 || hybrid_ratio > 100)
+					usage(argv[0]);
+				break;
 			case 'n':
 				num_processes = atoi(optarg);
 				break;
+			case 'o':
+				sort_by_location = 1;
+				break;
 			case 'p':
 				proc_node_id = atoi(optarg);
 				break;
+			case 'r':
+				use_completion_ring = 1;
+				break;
 			case 's':
 				buffer_size = (size_t)atol(optarg) << 20;	/* size in MB */
 				break;
+			case 'w':
+				print_wakeup_stat = 1;
+				break;
 			default:
 				usage(argv[0]);
 				break;
@@ -332,6 +570,16 @@ main(int argc, char *argv[])
 		ELOG(errno, "failed on open('%s')", source_filename);
 	if (fstat(source_fdesc, &source_fstat))
 		ELOG(errno, "failed on fstat('%s')", source_filename);
+	/* raw block device has no st_size */
+	if (S_ISBLK(source_fstat.st_mode))
+	{
+		uint64_t	devsize;
+
+		if (ioctl(source_fdesc, BLKGETSIZE64, &devsize))
+			ELOG(errno, "failed on ioctl('%s', BLKGETSIZE64)",
+				 source_filename);
+		source_fstat.st_size = devsize;
+	}
 
 	/* Get NUMA node-id */
 	numa_node_id = run_ioctl_check_file(source_fdesc);
@@ -343,6 +591,8 @@ main(int argc, char *argv[])
 	/* Setup CPU affinity based on NUMA node-id */
 	setup_cpu_affinity(proc_node_id);
 	/* Launch worker threads if any */
+	if (print_wakeup_stat)
+		fetch_wakeup_stat(&wakeup_stat[0]);
 	gettimeofday(&tv1, NULL);
 	if (num_processes > 0)
 	{
@@ -371,7 +621,17 @@ main(int argc, char *argv[])
 	}
 	gettimeofday(&tv2, NULL);
 
-	print_results((tv2.tv_sec * 1000 + tv2.tv_usec / 1000) -
-				  (tv1.tv_sec * 1000 + tv1.tv_usec / 1000));
+	time_ms = ((tv2.tv_sec * 1000 + tv2.tv_usec / 1000) -
+			   (tv1.tv_sec * 1000 + tv1.tv_usec / 1000));
+	print_results(time_ms);
+	/*
+	 * Wake up statistics with many concurrent waiters, e.g '-n 64'.
+	 * Note that it also counts the waits by other processes, if any.
+	 */
+	if (print_wakeup_stat)
+	{
+		fetch_wakeup_stat(&wakeup_stat[1]);
+		report_wakeup_stat(&wakeup_stat[0], &wakeup_stat[1], time_ms);
+	}
 	return 0;
 }
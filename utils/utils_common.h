@@ -36,10 +36,10 @@
 	} while(0)
 
 /*
- * nvme_strom_ioctl - entrypoint of NVME-Strom
+ * nvme_strom_fdesc - file descriptor of NVME-Strom for this thread
  */
 static int
-nvme_strom_ioctl(int cmd, const void *arg)
+nvme_strom_fdesc(void)
 {
 	static __thread int fdesc_nvme_strom = -1;
 
@@ -49,7 +49,16 @@ nvme_strom_ioctl(int cmd, const void *arg)
 		if (fdesc_nvme_strom < 0)
 			ELOG(errno, "failed to open \"%s\"", NVME_STROM_IOCTL_PATHNAME);
 	}
-    return ioctl(fdesc_nvme_strom, cmd, arg);
+	return fdesc_nvme_strom;
+}
+
+/*
+ * nvme_strom_ioctl - entrypoint of NVME-Strom
+ */
+static int
+nvme_strom_ioctl(int cmd, const void *arg)
+{
+    return ioctl(nvme_strom_fdesc(), cmd, arg);
 }
 
 